@@ -2,27 +2,74 @@
 
 #include <atomic>
 #include <algorithm>
+#include <chrono>
 
+#include "types.h"
+
+// Logical clock shared by the protocol, send and receive paths. Every update is a compare-and-swap, so a
+// tick racing a receive never loses either. In HYBRID mode the value is a hybrid logical clock: physical
+// milliseconds shifted past HLC_LOGICAL_BITS plus a logical counter. It still orders events causally like
+// the Lamport clock, and its high bits read as wall time on every rank.
 class ClockManager
 {
 public:
-    ClockManager() : local_clock(0) {}
+    static const int HLC_LOGICAL_BITS = 16;
+
+    explicit ClockManager(ClockMode clock_mode = ClockMode::LAMPORT)
+        : mode(clock_mode), local_clock(0), externally_clocked(false), external_millis(0) {}
 
-    void increment()
+    // Advances the clock for a local event and returns the new value.
+    Timestamp tick()
     {
-        local_clock++;
+        return advancePast(0);
     }
 
-    void updateOnReceive(int received_timestamp)
+    void updateOnReceive(Timestamp received_timestamp)
     {
-        local_clock = std::max(local_clock.load(), received_timestamp) + 1;
+        advancePast(received_timestamp);
     }
 
-    int getTime() const
+    Timestamp getTime() const
     {
         return local_clock.load();
     }
 
+    // Drivers stepping processes in virtual time (the simulator) supply the physical component themselves.
+    void setPhysicalTime(std::chrono::steady_clock::time_point now)
+    {
+        externally_clocked = true;
+        external_millis = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+    }
+
 private:
-    std::atomic<int> local_clock;
-};
\ No newline at end of file
+    const ClockMode mode;
+    std::atomic<Timestamp> local_clock;
+    bool externally_clocked;
+    long long external_millis;
+
+    // The logical counter is not saturated: more than 2^HLC_LOGICAL_BITS events within one millisecond carry
+    // into the physical field. Ordering stays causal and monotonic; the clock merely runs ahead of wall time
+    // until wall time catches up, which is preferable to stalling the protocol thread for the next millisecond.
+    Timestamp advancePast(Timestamp floor)
+    {
+        Timestamp physical = mode == ClockMode::HYBRID ? physicalNow() << HLC_LOGICAL_BITS : 0;
+        Timestamp current = local_clock.load();
+        Timestamp next;
+        do
+        {
+            next = std::max({current + 1, floor + 1, physical});
+        } while (!local_clock.compare_exchange_weak(current, next));
+        return next;
+    }
+
+    Timestamp physicalNow() const
+    {
+        if (externally_clocked)
+        {
+            return external_millis;
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+};
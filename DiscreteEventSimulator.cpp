@@ -0,0 +1,254 @@
+#include "DiscreteEventSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+bool LatencyModel::parse(const std::string &text, LatencyModel &model)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, ':'))
+    {
+        parts.push_back(part);
+    }
+
+    try
+    {
+        if (parts.size() == 2 && parts[0] == "fixed")
+        {
+            model = {Kind::FIXED, std::stod(parts[1]), 0.0};
+        }
+        else if (parts.size() == 3 && parts[0] == "uniform")
+        {
+            model = {Kind::UNIFORM, std::stod(parts[1]), std::stod(parts[2])};
+        }
+        else if (parts.size() == 3 && parts[0] == "exp")
+        {
+            model = {Kind::EXPONENTIAL, std::stod(parts[1]), std::stod(parts[2])};
+        }
+        else
+        {
+            return false;
+        }
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    if (model.a_us < 0.0 || model.b_us < 0.0 || (model.kind == Kind::UNIFORM && model.b_us < model.a_us) ||
+        (model.kind == Kind::EXPONENTIAL && model.b_us <= 0.0))
+    {
+        return false;
+    }
+    return true;
+}
+
+bool StallSpec::parse(const std::string &text, StallSpec &stall)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, ':'))
+    {
+        parts.push_back(part);
+    }
+    if (parts.size() != 3)
+    {
+        return false;
+    }
+
+    try
+    {
+        size_t used[3] = {0, 0, 0};
+        stall = {std::stoi(parts[0], &used[0]), std::stod(parts[1], &used[1]), std::stod(parts[2], &used[2])};
+        for (int i = 0; i < 3; ++i)
+        {
+            if (used[i] != parts[i].size())
+            {
+                return false;
+            }
+        }
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    return stall.process_id > 0 && stall.at_ms >= 0.0 && stall.for_ms > 0.0;
+}
+
+SimulatedTransport::SimulatedTransport(DiscreteEventSimulator &sim, int rank) : simulator(sim), my_rank(rank) {}
+
+int SimulatedTransport::size() const
+{
+    return simulator.size();
+}
+
+void SimulatedTransport::sendBatches(std::vector<TransportBatch> &batches)
+{
+    for (TransportBatch &batch : batches)
+    {
+        simulator.scheduleDelivery(my_rank, batch.target_rank, std::move(batch.words));
+    }
+}
+
+void SimulatedTransport::startBarrier()
+{
+    simulator.arriveAtBarrier();
+}
+
+bool SimulatedTransport::testBarrier()
+{
+    return simulator.barrierComplete();
+}
+
+DiscreteEventSimulator::DiscreteEventSimulator(const SimConfig &config, const LatencyModel &latency_model,
+                                               const StallSpec &stall)
+    : latency(latency_model), rng(config.seed), now(), next_sequence(0), events_processed(0), house_window(config.d_houses),
+      next_wake(config.n_processes, TimePoint::max()), finished_count(0), barrier_arrivals(0),
+      stalled_rank(stall.process_id > 0 && stall.process_id <= config.n_processes ? stall.process_id - 1 : -1),
+      stall_start(std::chrono::duration_cast<TimePoint::duration>(std::chrono::duration<double, std::milli>(stall.at_ms))),
+      stall_end(stall_start + std::chrono::duration_cast<TimePoint::duration>(std::chrono::duration<double, std::milli>(stall.for_ms))),
+      pasers(config.p_pasers), house_holders(config.d_houses + 1, 0), held_house(config.n_processes, 0),
+      held_paser(config.n_processes, false), pasers_held(0), house_violations(0), paser_violations(0)
+{
+    transports.reserve(config.n_processes);
+    processes.reserve(config.n_processes);
+    for (int rank = 0; rank < config.n_processes; ++rank)
+    {
+        transports.push_back(std::make_unique<SimulatedTransport>(*this, rank));
+        processes.push_back(std::make_unique<ProcessLogic>(rank + 1, config, *transports.back(), &house_window));
+    }
+}
+
+void DiscreteEventSimulator::push(TimePoint time, int rank, bool is_delivery, std::vector<int> &&words)
+{
+    events.push_back({time, next_sequence++, rank, is_delivery, std::move(words)});
+    std::push_heap(events.begin(), events.end(), EventLater());
+}
+
+std::chrono::nanoseconds DiscreteEventSimulator::sampleLatency()
+{
+    double delay_us = latency.a_us;
+    switch (latency.kind)
+    {
+    case LatencyModel::Kind::FIXED:
+        break;
+    case LatencyModel::Kind::UNIFORM:
+        delay_us = std::uniform_real_distribution<double>(latency.a_us, latency.b_us)(rng);
+        break;
+    case LatencyModel::Kind::EXPONENTIAL:
+        delay_us += std::exponential_distribution<double>(1.0 / latency.b_us)(rng);
+        break;
+    }
+    return std::chrono::nanoseconds(std::llround(delay_us * 1000.0));
+}
+
+void DiscreteEventSimulator::scheduleDelivery(int from_rank, int to_rank, std::vector<int> &&words)
+{
+    TimePoint arrival = now + sampleLatency();
+    TimePoint &channel_tail = last_delivery[static_cast<long long>(from_rank) * size() + to_rank];
+    arrival = std::max(arrival, channel_tail);
+    channel_tail = arrival;
+    push(arrival, to_rank, true, std::move(words));
+}
+
+bool DiscreteEventSimulator::postponeIfStalled(Event &event)
+{
+    if (event.rank != stalled_rank || now < stall_start || now >= stall_end)
+    {
+        return false;
+    }
+    if (event.is_delivery)
+    {
+        // The original sequence keeps the batch ahead of later ones on its channel that land at stall_end too.
+        events.push_back({stall_end, event.sequence, event.rank, true, std::move(event.words)});
+        std::push_heap(events.begin(), events.end(), EventLater());
+    }
+    else if (event.time == next_wake[event.rank])
+    {
+        next_wake[event.rank] = stall_end;
+        push(stall_end, event.rank, false, {});
+    }
+    return true;
+}
+
+void DiscreteEventSimulator::checkExclusion(int rank)
+{
+    ProcessLogic &logic = *processes[rank];
+    int house_id = logic.heldHouseId();
+    if (house_id != held_house[rank])
+    {
+        if (held_house[rank] != 0)
+        {
+            house_holders[held_house[rank]]--;
+        }
+        if (house_id > 0 && house_id < static_cast<int>(house_holders.size()) && ++house_holders[house_id] > 1)
+        {
+            house_violations++;
+        }
+        held_house[rank] = house_id;
+    }
+    bool paser = logic.holdsPaser();
+    if (paser != held_paser[rank])
+    {
+        pasers_held += paser ? 1 : -1;
+        if (paser && pasers_held > pasers)
+        {
+            paser_violations++;
+        }
+        held_paser[rank] = paser;
+    }
+}
+
+void DiscreteEventSimulator::stepProcess(int rank)
+{
+    ProcessLogic &logic = *processes[rank];
+    TimePoint deadline = logic.step(now);
+    checkExclusion(rank);
+    if (logic.isFinished())
+    {
+        logic.finish(now);
+        finished_count++;
+        return;
+    }
+    if (deadline != next_wake[rank] && deadline != TimePoint::max())
+    {
+        next_wake[rank] = deadline;
+        push(deadline, rank, false, {});
+    }
+}
+
+void DiscreteEventSimulator::run()
+{
+    for (int rank = 0; rank < size(); ++rank)
+    {
+        processes[rank]->start(now);
+        stepProcess(rank);
+    }
+
+    while (!events.empty() && finished_count < size())
+    {
+        std::pop_heap(events.begin(), events.end(), EventLater());
+        Event event = std::move(events.back());
+        events.pop_back();
+        now = event.time;
+        events_processed++;
+
+        ProcessLogic &logic = *processes[event.rank];
+        if (logic.isFinished() || postponeIfStalled(event))
+        {
+            continue;
+        }
+        if (event.is_delivery)
+        {
+            logic.deliverBatch(event.words.data(), now);
+        }
+        else if (event.time != next_wake[event.rank])
+        {
+            continue; // superseded by a later step
+        }
+        stepProcess(event.rank);
+    }
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+#include "Transport.h"
+#include "HouseWindow.h"
+#include "ProcessLogic.h"
+
+// One-way delay of every simulated batch, in microseconds.
+struct LatencyModel
+{
+    enum class Kind
+    {
+        FIXED,      // a
+        UNIFORM,    // a..b
+        EXPONENTIAL // a + Exp(mean b)
+    };
+    Kind kind = Kind::FIXED;
+    double a_us = 50.0;
+    double b_us = 0.0;
+
+    // "fixed:US", "uniform:MIN:MAX" or "exp:BASE:MEAN"; returns false on anything else.
+    static bool parse(const std::string &text, LatencyModel &model);
+};
+
+// One process that stops for a while: deliveries and wake-ups due in [at_ms, at_ms + for_ms) of virtual time
+// are held back until the stall ends, as if the process were descheduled. It sends no heartbeats meanwhile, so
+// a stall longer than the failure detector's timeout gets a live process suspected.
+struct StallSpec
+{
+    int process_id = 0; // 0: no stall
+    double at_ms = 0.0;
+    double for_ms = 0.0;
+
+    // "ID:AT_MS:FOR_MS"; returns false on anything else.
+    static bool parse(const std::string &text, StallSpec &stall);
+};
+
+class DiscreteEventSimulator;
+
+// Transport that turns every batch into a delivery event on the simulator's queue.
+class SimulatedTransport : public Transport
+{
+public:
+    SimulatedTransport(DiscreteEventSimulator &simulator, int rank);
+
+    int rank() const override { return my_rank; }
+    int size() const override;
+
+    void sendBatches(std::vector<TransportBatch> &batches) override;
+
+    // The simulator delivers batches itself, so there is nothing to receive from.
+    void startReceiving(int) override {}
+    bool waitForBatches() override { return false; }
+    const int *nextBatch() override { return nullptr; }
+    void releaseBatch() override {}
+    void stopReceiving() override {}
+    void wakeReceiver() override {}
+
+    void startBarrier() override;
+    bool testBarrier() override;
+    void waitBarrier() override {}
+
+private:
+    DiscreteEventSimulator &simulator;
+    int my_rank;
+};
+
+// Runs every ProcessLogic on one thread against a virtual clock: a heap of timed events (batch deliveries and
+// process wake-ups) is processed in time order, so nothing ever sleeps. Runs are reproducible from config.seed.
+// Since every process lives here, the simulator also checks mutual exclusion after each step.
+class DiscreteEventSimulator
+{
+public:
+    DiscreteEventSimulator(const SimConfig &config, const LatencyModel &latency, const StallSpec &stall = {});
+
+    void run();
+
+    int size() const { return static_cast<int>(processes.size()); }
+    const ProcessLogic &process(int rank) const { return *processes[rank]; }
+    ProcessLogic &process(int rank) { return *processes[rank]; }
+    double simulatedSeconds() const { return std::chrono::duration<double>(now - TimePoint{}).count(); }
+    long long eventsProcessed() const { return events_processed; }
+    // Steps after which a house had two holders, or more than P pasers were held.
+    long long houseViolations() const { return house_violations; }
+    long long paserViolations() const { return paser_violations; }
+
+    void scheduleDelivery(int from_rank, int to_rank, std::vector<int> &&words);
+    void arriveAtBarrier() { barrier_arrivals++; }
+    bool barrierComplete() const { return barrier_arrivals >= size(); }
+
+private:
+    struct Event
+    {
+        TimePoint time;
+        long long sequence; // ties are broken in scheduling order
+        int rank;
+        bool is_delivery;
+        std::vector<int> words;
+    };
+    struct EventLater
+    {
+        bool operator()(const Event &a, const Event &b) const
+        {
+            return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+        }
+    };
+
+    LatencyModel latency;
+    std::mt19937_64 rng;
+    TimePoint now;
+    std::vector<Event> events; // min-heap on (time, sequence)
+    long long next_sequence;
+    long long events_processed;
+
+    SharedHouseWindow house_window; // claims take effect at once, in virtual time as in wall time
+    std::vector<std::unique_ptr<SimulatedTransport>> transports;
+    std::vector<std::unique_ptr<ProcessLogic>> processes;
+    std::vector<TimePoint> next_wake; // latest wake-up scheduled per rank; older wake events are stale
+    std::unordered_map<long long, TimePoint> last_delivery; // per (from, to) pair, to keep channels FIFO like MPI
+    int finished_count;
+    int barrier_arrivals;
+
+    int stalled_rank; // -1: none
+    TimePoint stall_start;
+    TimePoint stall_end;
+
+    const int pasers;
+    std::vector<int> house_holders; // by house id
+    std::vector<int> held_house;    // by rank
+    std::vector<bool> held_paser;   // by rank
+    int pasers_held;
+    long long house_violations;
+    long long paser_violations;
+
+    void push(TimePoint time, int rank, bool is_delivery, std::vector<int> &&words);
+    bool postponeIfStalled(Event &event);
+    void checkExclusion(int rank);
+    void stepProcess(int rank);
+    std::chrono::nanoseconds sampleLatency();
+};
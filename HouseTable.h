@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+// House states indexed 1..D in a flat array, with a bitmap of free houses for find-first-set lookups.
+// Each house also carries a version that its holder bumps on acquire and release, so replies can piggyback
+// the table and receivers keep whichever entry is newer.
+class HouseTable
+{
+public:
+    explicit HouseTable(int d_houses)
+        : states(d_houses + 1, HOUSE_STATE_FREE), versions(d_houses + 1, 0), free_bits((d_houses + 64) / 64, 0),
+          house_count(d_houses)
+    {
+        for (int house_id = 1; house_id <= house_count; ++house_id)
+        {
+            free_bits[house_id / 64] |= std::uint64_t(1) << (house_id % 64);
+        }
+    }
+
+    int size() const { return house_count; }
+    bool contains(int house_id) const { return house_id > 0 && house_id <= house_count; }
+    int status(int house_id) const { return states[house_id]; }
+    bool isFree(int house_id) const { return states[house_id] == HOUSE_STATE_FREE; }
+
+    void set(int house_id, int status)
+    {
+        states[house_id] = status;
+        std::uint64_t mask = std::uint64_t(1) << (house_id % 64);
+        if (status == HOUSE_STATE_FREE)
+        {
+            free_bits[house_id / 64] |= mask;
+        }
+        else
+        {
+            free_bits[house_id / 64] &= ~mask;
+        }
+    }
+
+    // Local ownership change made by the process that holds the house lock.
+    void record(int house_id, int status)
+    {
+        set(house_id, status);
+        touch(house_id, versions[house_id] + 1);
+    }
+
+    bool merge(int house_id, int status, int version)
+    {
+        if (!contains(house_id) || version <= versions[house_id])
+        {
+            return false;
+        }
+        set(house_id, status);
+        touch(house_id, version);
+        return true;
+    }
+
+    // Version vector wire format: (house id, status, version) for every house that has ever changed.
+    void appendVersionVector(std::vector<int> &out) const
+    {
+        out.reserve(out.size() + 3 * touched_houses.size());
+        for (int house_id : touched_houses)
+        {
+            out.push_back(house_id);
+            out.push_back(states[house_id]);
+            out.push_back(versions[house_id]);
+        }
+    }
+
+    // A single version vector entry, for a holder announcing its own change.
+    void appendEntry(std::vector<int> &out, int house_id) const
+    {
+        out.push_back(house_id);
+        out.push_back(states[house_id]);
+        out.push_back(versions[house_id]);
+    }
+
+    int mergeVersionVector(const std::vector<int> &in, size_t first = 0)
+    {
+        int updated = 0;
+        for (size_t i = first; i + 2 < in.size(); i += 3)
+        {
+            updated += merge(in[i], in[i + 1], in[i + 2]) ? 1 : 0;
+        }
+        return updated;
+    }
+
+    // A bitmap of house ids in the same layout as the free bitmap, for callers that skip some houses.
+    std::vector<std::uint64_t> emptyMask() const { return std::vector<std::uint64_t>(free_bits.size(), 0); }
+    static void addToMask(std::vector<std::uint64_t> &mask, int house_id)
+    {
+        mask[house_id / 64] |= std::uint64_t(1) << (house_id % 64);
+    }
+
+    // First free house not in `excluded`, searching from start_id up to D and then wrapping to 1; 0 if none.
+    int findFreeFrom(int start_id, const std::vector<std::uint64_t> &excluded) const
+    {
+        int found = firstFreeIn(start_id, house_count, excluded);
+        return found != 0 ? found : firstFreeIn(1, start_id - 1, excluded);
+    }
+
+    // Returns preferred_id if it is free, otherwise the lowest free house id, or 0 if none is free.
+    int findFree(int preferred_id = 0) const
+    {
+        if (contains(preferred_id) && isFree(preferred_id))
+        {
+            return preferred_id;
+        }
+        for (size_t word = 0; word < free_bits.size(); ++word)
+        {
+            if (free_bits[word] != 0)
+            {
+                return static_cast<int>(word * 64 + __builtin_ctzll(free_bits[word]));
+            }
+        }
+        return 0;
+    }
+
+private:
+    std::vector<int> states;
+    std::vector<int> versions;
+    std::vector<std::uint64_t> free_bits;
+    std::vector<int> touched_houses;
+    int house_count;
+
+    int firstFreeIn(int first_id, int last_id, const std::vector<std::uint64_t> &excluded) const
+    {
+        for (int house_id = std::max(first_id, 1); house_id <= last_id;)
+        {
+            size_t word = house_id / 64;
+            std::uint64_t bits = free_bits[word] & ~excluded[word] & (~std::uint64_t(0) << (house_id % 64));
+            if (bits != 0)
+            {
+                int found = static_cast<int>(word * 64 + __builtin_ctzll(bits));
+                return found <= last_id ? found : 0;
+            }
+            house_id = static_cast<int>((word + 1) * 64);
+        }
+        return 0;
+    }
+
+    void touch(int house_id, int version)
+    {
+        if (versions[house_id] == 0)
+        {
+            touched_houses.push_back(house_id);
+        }
+        versions[house_id] = version;
+    }
+};
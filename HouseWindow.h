@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "types.h"
+
+// House ownership kept in memory that every process reaches with one-sided atomics, for
+// MutexAlgorithm::HOUSE_WINDOW. A house is claimed by swapping its status from HOUSE_STATE_FREE to the claimant's
+// id and released by swapping it back, so no lock messages or UPDATE_HOUSE_STATE broadcasts are needed and the
+// choice of house always sees current state. Houses are numbered from 1 like everywhere else.
+class HouseWindow
+{
+public:
+    virtual ~HouseWindow() = default;
+
+    // Fills statuses[house_id - 1] for every house; each entry is read atomically, the whole copy is not.
+    virtual void read(std::vector<int> &statuses) = 0;
+    // Sets the house to desired if it is expected; returns the status found either way.
+    virtual int compareAndSwap(int house_id, int expected, int desired) = 0;
+};
+
+// Plain shared memory, for processes that are threads of one executable or run inside the simulator.
+class SharedHouseWindow : public HouseWindow
+{
+public:
+    explicit SharedHouseWindow(int house_count) : statuses(std::make_unique<std::atomic<int>[]>(house_count)), count(house_count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            statuses[i].store(HOUSE_STATE_FREE);
+        }
+    }
+
+    void read(std::vector<int> &out) override
+    {
+        out.resize(count);
+        for (int i = 0; i < count; ++i)
+        {
+            out[i] = statuses[i].load();
+        }
+    }
+
+    int compareAndSwap(int house_id, int expected, int desired) override
+    {
+        statuses[house_id - 1].compare_exchange_strong(expected, desired);
+        return expected;
+    }
+
+private:
+    std::unique_ptr<std::atomic<int>[]> statuses;
+    int count;
+};
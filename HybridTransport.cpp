@@ -0,0 +1,181 @@
+#include "HybridTransport.h"
+
+#include <chrono>
+#include <limits>
+
+#include "TransportBundle.h"
+
+HybridNode::HybridNode(int processes_per_rank)
+    : local_count(processes_per_rank), local_network(processes_per_rank), barrier_arrivals(0), barrier_done(false),
+      barrier_request(MPI_REQUEST_NULL), remote_messages(0), remote_batches(0)
+{
+    MPI_Comm_dup(MPI_COMM_WORLD, &node_comm);
+    MPI_Comm_rank(node_comm, &mpi_rank);
+    MPI_Comm_size(node_comm, &mpi_size);
+}
+
+void HybridNode::startDispatcher()
+{
+    dispatcher_thread = std::thread([this]()
+                                    { runDispatcher(); });
+}
+
+void HybridNode::runDispatcher()
+{
+    // Matched probe sizes each receive exactly and hands a lone batch to the mailbox without a copy.
+    std::vector<int> bundle;
+    while (true)
+    {
+        MPI_Message message;
+        MPI_Status status;
+        MPI_Mprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, node_comm, &message, &status);
+        if (status.MPI_TAG == local_count)
+        {
+            MPI_Mrecv(nullptr, 0, MPI_INT, &message, MPI_STATUS_IGNORE);
+            break;
+        }
+        int count = 0;
+        MPI_Get_count(&status, MPI_INT, &count);
+        if (status.MPI_TAG == bundleTag())
+        {
+            bundle.resize(count);
+            MPI_Mrecv(bundle.data(), count, MPI_INT, &message, MPI_STATUS_IGNORE);
+            deliverBundle(bundle);
+            continue;
+        }
+        auto *node = new InProcessNetwork::Node{nullptr, std::vector<int>(count)};
+        MPI_Mrecv(node->words.data(), count, MPI_INT, &message, MPI_STATUS_IGNORE);
+        local_network.mailbox(status.MPI_TAG).push(node);
+    }
+}
+
+void HybridNode::deliverBundle(const std::vector<int> &bundle)
+{
+    TransportBundle::unpack(bundle.data(), [this](int local_target, const int *words, int length)
+                            {
+        std::vector<int> batch(words, words + length);
+        local_network.mailbox(local_target).push(new InProcessNetwork::Node{nullptr, std::move(batch)}); });
+}
+
+void HybridNode::stop()
+{
+    MPI_Barrier(node_comm);
+    // Tag K is never a local index, so it doubles as the dispatcher's shutdown signal.
+    MPI_Send(nullptr, 0, MPI_INT, mpi_rank, local_count, node_comm);
+    if (dispatcher_thread.joinable())
+    {
+        dispatcher_thread.join();
+    }
+    MPI_Comm_free(&node_comm);
+}
+
+void HybridNode::sendRemote(std::vector<RemoteMessage> &messages, long long batches, MpiPendingSends &sends)
+{
+    sends.reap();
+    for (RemoteMessage &message : messages)
+    {
+        sends.post(std::move(message.words), message.mpi_rank, message.tag, node_comm);
+    }
+    remote_messages.fetch_add(static_cast<long long>(messages.size()), std::memory_order_relaxed);
+    remote_batches.fetch_add(batches, std::memory_order_relaxed);
+}
+
+void HybridNode::arriveAtBarrier()
+{
+    std::lock_guard<std::mutex> lock(barrier_mutex);
+    if (++barrier_arrivals == local_count)
+    {
+        MPI_Ibarrier(node_comm, &barrier_request);
+    }
+}
+
+bool HybridNode::barrierComplete()
+{
+    std::lock_guard<std::mutex> lock(barrier_mutex);
+    if (!barrier_done && barrier_arrivals == local_count)
+    {
+        int flag = 0;
+        MPI_Test(&barrier_request, &flag, MPI_STATUS_IGNORE);
+        barrier_done = flag != 0;
+    }
+    return barrier_done;
+}
+
+HybridTransport::HybridTransport(HybridNode &hybrid_node, int local)
+    : InProcessTransport(hybrid_node.localNetwork(), local), node(hybrid_node), local_index(local),
+      batches_by_rank(hybrid_node.mpiSize()) {}
+
+void HybridTransport::sendBatches(std::vector<TransportBatch> &batches)
+{
+    int first_local_rank = node.mpiRank() * node.processesPerRank();
+    remote_batches.clear();
+    for (TransportBatch &batch : batches)
+    {
+        int local_target = batch.target_rank - first_local_rank;
+        if (local_target >= 0 && local_target < node.processesPerRank())
+        {
+            node.localNetwork().mailbox(local_target).push(new InProcessNetwork::Node{nullptr, std::move(batch.words)});
+        }
+        else
+        {
+            remote_batches.push_back(std::move(batch));
+        }
+    }
+    if (remote_batches.empty())
+    {
+        return;
+    }
+
+    // Group by destination rank; batches keep their order within a rank, so per-target FIFO order holds.
+    ranks_in_order.clear();
+    for (size_t i = 0; i < remote_batches.size(); ++i)
+    {
+        int mpi_rank = remote_batches[i].target_rank / node.processesPerRank();
+        if (batches_by_rank[mpi_rank].empty())
+        {
+            ranks_in_order.push_back(mpi_rank);
+        }
+        batches_by_rank[mpi_rank].push_back(i);
+    }
+    remote_messages.clear();
+    for (int mpi_rank : ranks_in_order)
+    {
+        appendBundle(mpi_rank, batches_by_rank[mpi_rank]);
+        batches_by_rank[mpi_rank].clear();
+    }
+    node.sendRemote(remote_messages, static_cast<long long>(remote_batches.size()), remote_sends);
+}
+
+void HybridTransport::appendBundle(int mpi_rank, const std::vector<size_t> &indices)
+{
+    int local_count = node.processesPerRank();
+    if (indices.size() == 1)
+    {
+        TransportBatch &batch = remote_batches[indices[0]];
+        remote_messages.push_back({mpi_rank, batch.target_rank % local_count, std::move(batch.words)});
+        return;
+    }
+
+    packed.clear();
+    TransportBundle::pack(remote_batches, indices, mpi_rank * local_count, local_count,
+                          std::numeric_limits<size_t>::max(), packed);
+    remote_messages.push_back({mpi_rank, node.bundleTag(), std::move(packed.front())});
+}
+
+void HybridTransport::startBarrier()
+{
+    node.arriveAtBarrier();
+}
+
+bool HybridTransport::testBarrier()
+{
+    return node.barrierComplete();
+}
+
+void HybridTransport::waitBarrier()
+{
+    while (!node.barrierComplete())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <mpi.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "InProcessTransport.h"
+#include "MpiPendingSends.h"
+
+// One MPI rank hosting K logical processes. Logical rank r lives on MPI rank r / K as local process r % K.
+// Local traffic goes straight into the InProcessNetwork mailboxes. Remote traffic is broadcast hierarchically:
+// each flush sends at most one MPI message per remote rank, and that rank's dispatcher thread, the leader of
+// its K processes, fans it out into their mailboxes. A lone batch travels as is, tagged with the target's local
+// index; several batches travel as a TransportBundle addressed by local index.
+class HybridNode
+{
+public:
+    // One MPI message of a flush: a plain batch (tag = local index) or a bundle (tag = bundleTag()).
+    struct RemoteMessage
+    {
+        int mpi_rank;
+        int tag;
+        std::vector<int> words;
+    };
+
+    explicit HybridNode(int processes_per_rank);
+
+    int processesPerRank() const { return local_count; }
+    int mpiRank() const { return mpi_rank; }
+    int mpiSize() const { return mpi_size; }
+    int bundleTag() const { return local_count + 1; }
+    InProcessNetwork &localNetwork() { return local_network; }
+
+    void startDispatcher();
+    // Collective: waits until every rank's logical processes have finished sending, then stops the dispatcher.
+    void stop();
+
+    // Posts the messages into the calling send thread's own in-flight set; nothing waits for their receivers.
+    void sendRemote(std::vector<RemoteMessage> &messages, long long batches, MpiPendingSends &sends);
+    // Inter-rank traffic of this rank's processes: MPI messages sent and the batches they carried.
+    long long remoteMessagesSent() const { return remote_messages.load(); }
+    long long remoteBatchesSent() const { return remote_batches.load(); }
+
+    void arriveAtBarrier();
+    bool barrierComplete();
+
+private:
+    int local_count;
+    int mpi_rank;
+    int mpi_size;
+    MPI_Comm node_comm; // private communicator so the dispatcher can receive any tag
+    InProcessNetwork local_network;
+    std::thread dispatcher_thread;
+
+    std::mutex barrier_mutex;
+    int barrier_arrivals;
+    bool barrier_done;
+    MPI_Request barrier_request;
+
+    std::atomic<long long> remote_messages;
+    std::atomic<long long> remote_batches;
+
+    void runDispatcher();
+    void deliverBundle(const std::vector<int> &bundle);
+};
+
+class HybridTransport : public InProcessTransport
+{
+public:
+    HybridTransport(HybridNode &node, int local_index);
+
+    int rank() const override { return node.mpiRank() * node.processesPerRank() + local_index; }
+    int size() const override { return node.mpiSize() * node.processesPerRank(); }
+
+    void sendBatches(std::vector<TransportBatch> &batches) override;
+    bool reapSends() override { return remote_sends.reap(); }
+    void waitSends() override { remote_sends.waitAll(); }
+
+    void startBarrier() override;
+    bool testBarrier() override;
+    void waitBarrier() override;
+
+private:
+    HybridNode &node;
+    int local_index;
+    // Reused across flushes by this process's send thread.
+    std::vector<TransportBatch> remote_batches;
+    std::vector<std::vector<size_t>> batches_by_rank; // indices into remote_batches, by MPI rank
+    std::vector<int> ranks_in_order;
+    std::vector<HybridNode::RemoteMessage> remote_messages;
+    std::vector<std::vector<int>> packed;
+    MpiPendingSends remote_sends;
+
+    void appendBundle(int mpi_rank, const std::vector<size_t> &indices);
+};
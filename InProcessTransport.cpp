@@ -0,0 +1,160 @@
+#include "InProcessTransport.h"
+
+#include <chrono>
+#include <thread>
+
+void InProcessNetwork::Mailbox::push(Node *node)
+{
+    Node *old_head = head.load(std::memory_order_relaxed);
+    do
+    {
+        node->next = old_head;
+    } while (!head.compare_exchange_weak(old_head, node));
+
+    // Pairs with the receiver storing receiver_waiting before it re-checks head, so one of us sees the other.
+    if (receiver_waiting.load())
+    {
+        wake();
+    }
+}
+
+void InProcessNetwork::Mailbox::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(park_mutex);
+    }
+    park_cv.notify_one();
+}
+
+InProcessNetwork::Mailbox::~Mailbox()
+{
+    Node *node = head.exchange(nullptr);
+    while (node)
+    {
+        Node *next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+InProcessNetwork::InProcessNetwork(int process_count) : barrier_arrivals(0)
+{
+    mailboxes.reserve(process_count);
+    for (int i = 0; i < process_count; ++i)
+    {
+        mailboxes.push_back(std::make_unique<Mailbox>());
+    }
+}
+
+InProcessTransport::InProcessTransport(InProcessNetwork &net, int rank)
+    : network(net), my_rank(rank), inbox(net.mailbox(rank)), ready(nullptr), current(nullptr) {}
+
+InProcessTransport::~InProcessTransport()
+{
+    stopReceiving();
+}
+
+void InProcessTransport::sendBatches(std::vector<TransportBatch> &batches)
+{
+    for (TransportBatch &batch : batches)
+    {
+        network.mailbox(batch.target_rank).push(new InProcessNetwork::Node{nullptr, std::move(batch.words)});
+    }
+}
+
+void InProcessTransport::startReceiving(int)
+{
+    // Batches arrive as their own vectors, so there is no receive buffer to size.
+}
+
+bool InProcessTransport::takeAll()
+{
+    InProcessNetwork::Node *stack = inbox.head.exchange(nullptr, std::memory_order_acquire);
+    if (!stack)
+    {
+        return false;
+    }
+    // The stack is newest-first; reverse it so batches are handed out in push order.
+    InProcessNetwork::Node *fifo = nullptr;
+    while (stack)
+    {
+        InProcessNetwork::Node *next = stack->next;
+        stack->next = fifo;
+        fifo = stack;
+        stack = next;
+    }
+    ready = fifo;
+    return true;
+}
+
+bool InProcessTransport::waitForBatches()
+{
+    while (true)
+    {
+        if (ready || takeAll())
+        {
+            return true;
+        }
+        if (inbox.shutdown.load())
+        {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(inbox.park_mutex);
+        inbox.receiver_waiting = true;
+        inbox.park_cv.wait(lock, [this]()
+                           { return inbox.head.load() != nullptr || inbox.shutdown.load(); });
+        inbox.receiver_waiting = false;
+    }
+}
+
+const int *InProcessTransport::nextBatch()
+{
+    if (!ready && !takeAll())
+    {
+        return nullptr;
+    }
+    current = ready;
+    ready = ready->next;
+    return current->words.data();
+}
+
+void InProcessTransport::releaseBatch()
+{
+    delete current;
+    current = nullptr;
+}
+
+void InProcessTransport::stopReceiving()
+{
+    releaseBatch();
+    while (ready || takeAll())
+    {
+        InProcessNetwork::Node *next = ready->next;
+        delete ready;
+        ready = next;
+    }
+}
+
+void InProcessTransport::wakeReceiver()
+{
+    inbox.shutdown = true;
+    inbox.wake();
+}
+
+void InProcessTransport::startBarrier()
+{
+    network.arriveAtBarrier();
+}
+
+bool InProcessTransport::testBarrier()
+{
+    return network.barrierComplete();
+}
+
+void InProcessTransport::waitBarrier()
+{
+    while (!network.barrierComplete())
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
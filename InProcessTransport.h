@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Transport.h"
+
+// Shared by every logical process of one executable. Each rank owns a lock-free multi-producer mailbox:
+// senders push onto a Treiber stack with one CAS and the owner takes the whole stack with one exchange.
+class InProcessNetwork
+{
+public:
+    struct Node
+    {
+        Node *next;
+        std::vector<int> words;
+    };
+
+    struct Mailbox
+    {
+        std::atomic<Node *> head{nullptr};
+        // Only used to park an idle receiver; the message path never takes the mutex.
+        std::atomic<bool> receiver_waiting{false};
+        std::atomic<bool> shutdown{false};
+        std::mutex park_mutex;
+        std::condition_variable park_cv;
+
+        void push(Node *node);
+        void wake();
+        ~Mailbox();
+    };
+
+    explicit InProcessNetwork(int process_count);
+
+    int size() const { return static_cast<int>(mailboxes.size()); }
+    Mailbox &mailbox(int rank) { return *mailboxes[rank]; }
+
+    void arriveAtBarrier() { barrier_arrivals.fetch_add(1); }
+    bool barrierComplete() const { return barrier_arrivals.load() >= size(); }
+
+private:
+    std::vector<std::unique_ptr<Mailbox>> mailboxes;
+    std::atomic<int> barrier_arrivals;
+};
+
+class InProcessTransport : public Transport
+{
+public:
+    InProcessTransport(InProcessNetwork &network, int rank);
+    ~InProcessTransport() override;
+
+    int rank() const override { return my_rank; }
+    int size() const override { return network.size(); }
+
+    void sendBatches(std::vector<TransportBatch> &batches) override;
+
+    void startReceiving(int max_batch_words) override;
+    bool waitForBatches() override;
+    const int *nextBatch() override;
+    void releaseBatch() override;
+    void stopReceiving() override;
+    void wakeReceiver() override;
+
+    void startBarrier() override;
+    bool testBarrier() override;
+    void waitBarrier() override;
+
+private:
+    InProcessNetwork &network;
+    int my_rank;
+    InProcessNetwork::Mailbox &inbox;
+
+    // Nodes taken from the mailbox, oldest first; current is the batch handed out by nextBatch().
+    InProcessNetwork::Node *ready;
+    InProcessNetwork::Node *current;
+
+    bool takeAll();
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "types.h"
+
+// Decoded messages on their way from the listener to the protocol thread. Producers push a batch with one CAS;
+// the single consumer takes every batch with one exchange. The mutex only parks an idle consumer.
+class InboundQueue
+{
+public:
+    struct Node
+    {
+        Node *next;
+        std::vector<Message> messages;
+    };
+
+    InboundQueue() : head(nullptr), consumer_waiting(false), wake_requested(false) {}
+
+    ~InboundQueue()
+    {
+        Node *node = head.exchange(nullptr);
+        while (node)
+        {
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    void push(std::vector<Message> &&messages)
+    {
+        Node *node = new Node{nullptr, std::move(messages)};
+        Node *old_head = head.load(std::memory_order_relaxed);
+        do
+        {
+            node->next = old_head;
+        } while (!head.compare_exchange_weak(old_head, node));
+
+        // Pairs with the consumer storing consumer_waiting before it re-checks head, so one of us sees the other.
+        if (consumer_waiting.load())
+        {
+            notify();
+        }
+    }
+
+    // Everything pushed so far, oldest first; the caller deletes the nodes.
+    Node *takeAll()
+    {
+        Node *stack = head.exchange(nullptr, std::memory_order_acquire);
+        Node *fifo = nullptr;
+        while (stack)
+        {
+            Node *next = stack->next;
+            stack->next = fifo;
+            fifo = stack;
+            stack = next;
+        }
+        return fifo;
+    }
+
+    // Blocks until a batch is pushed, wake() is called or the deadline passes.
+    void waitUntil(std::chrono::steady_clock::time_point deadline)
+    {
+        consumer_waiting.store(true);
+        {
+            std::unique_lock<std::mutex> lock(park_mutex);
+            park_cv.wait_until(lock, deadline, [this]()
+                               { return head.load() != nullptr || wake_requested.load(); });
+        }
+        consumer_waiting.store(false);
+        wake_requested.store(false);
+    }
+
+    void wake()
+    {
+        wake_requested.store(true);
+        notify();
+    }
+
+private:
+    std::atomic<Node *> head;
+    std::atomic<bool> consumer_waiting;
+    std::atomic<bool> wake_requested;
+    std::mutex park_mutex;
+    std::condition_variable park_cv;
+
+    void notify()
+    {
+        {
+            std::lock_guard<std::mutex> lock(park_mutex);
+        }
+        park_cv.notify_one();
+    }
+};
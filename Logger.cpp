@@ -0,0 +1,180 @@
+#include "Logger.h"
+
+#include <chrono>
+
+Logger::Logger()
+    : runtime_level(LogLevel::OFF), overflow(LogOverflow::DROP), dropped_lines(0), terminate_writer_flag(false),
+      threads_registered(0), output(nullptr) {}
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+void Logger::start(const std::string &file_path, LogLevel level, LogOverflow overflow_policy)
+{
+    output = std::fopen(file_path.c_str(), "w");
+    if (!output)
+    {
+        std::fprintf(stderr, "Logger: cannot open %s, logging disabled.\n", file_path.c_str());
+        return;
+    }
+    overflow = overflow_policy;
+    terminate_writer_flag = false;
+    writer_thread = std::thread([this]()
+                                { runWriter(); });
+    runtime_level = level;
+}
+
+void Logger::stop()
+{
+    runtime_level = LogLevel::OFF;
+    terminate_writer_flag = true;
+    if (writer_thread.joinable())
+    {
+        writer_thread.join();
+    }
+    if (output)
+    {
+        drainRings();
+        if (dropped_lines.load() > 0)
+        {
+            std::fprintf(output, "Logger: dropped %llu lines (ring buffer full).\n", dropped_lines.load());
+        }
+        std::fclose(output);
+        output = nullptr;
+    }
+}
+
+LogLevel Logger::parseLevel(const std::string &name, LogLevel fallback)
+{
+    if (name == "debug")
+        return LogLevel::DEBUG;
+    if (name == "info")
+        return LogLevel::INFO;
+    if (name == "warn")
+        return LogLevel::WARN;
+    if (name == "error")
+        return LogLevel::ERROR;
+    if (name == "off")
+        return LogLevel::OFF;
+    return fallback;
+}
+
+bool Logger::parseOverflow(const std::string &name, LogOverflow &policy)
+{
+    if (name == "drop")
+        policy = LogOverflow::DROP;
+    else if (name == "block")
+        policy = LogOverflow::BLOCK;
+    else if (name == "spill")
+        policy = LogOverflow::SPILL;
+    else
+        return false;
+    return true;
+}
+
+Logger::Ring *Logger::localRing()
+{
+    thread_local Ring *ring = nullptr;
+    if (!ring)
+    {
+        ring = registerRing();
+    }
+    return ring;
+}
+
+Logger::Ring *Logger::registerRing()
+{
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    size_t index = threads_registered++ % RING_COUNT;
+    if (index == rings.size())
+    {
+        rings.push_back(std::make_unique<Ring>());
+    }
+    return rings[index].get();
+}
+
+bool Logger::drainRings()
+{
+    std::vector<Ring *> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (auto &ring : rings)
+        {
+            snapshot.push_back(ring.get());
+        }
+    }
+
+    bool wrote_any = false;
+    for (Ring *ring : snapshot)
+    {
+        if (!ring->spill_pending.load(std::memory_order_relaxed))
+        {
+            wrote_any |= drainRing(*ring);
+            continue;
+        }
+        // Every slot still in the ring predates the spill, and no producer can add to either meanwhile.
+        std::string spilled;
+        {
+            std::lock_guard<std::mutex> lock(ring->producer_mutex);
+            drainRing(*ring);
+            spilled.swap(ring->spill);
+            ring->spill_pending.store(false, std::memory_order_relaxed);
+        }
+        std::fwrite(spilled.data(), 1, spilled.size(), output);
+        wrote_any = true;
+    }
+    return wrote_any;
+}
+
+bool Logger::drainRing(Ring &ring)
+{
+    size_t tail = ring.tail.load(std::memory_order_relaxed);
+    size_t head = ring.head.load(std::memory_order_acquire);
+    bool wrote_any = tail != head;
+    for (; tail != head; ++tail)
+    {
+        Slot &slot = ring.slots[tail % RING_SLOTS];
+        slot.text[slot.length] = '\n';
+        std::fwrite(slot.text, 1, slot.length + 1, output);
+    }
+    ring.tail.store(tail, std::memory_order_release);
+    return wrote_any;
+}
+
+void Logger::runWriter()
+{
+    while (!terminate_writer_flag.load())
+    {
+        if (!drainRings())
+        {
+            std::fflush(output);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
+
+const char *Logger::levelTag(LogLevel level)
+{
+    switch (level)
+    {
+    case LogLevel::DEBUG:
+        return "D";
+    case LogLevel::INFO:
+        return "I";
+    case LogLevel::WARN:
+        return "W";
+    case LogLevel::ERROR:
+        return "E";
+    default:
+        return "?";
+    }
+}
+
+long long Logger::elapsedMicros()
+{
+    static const auto origin = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
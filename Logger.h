@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Levels below PROZ_LOG_COMPILE_LEVEL are folded away at compile time.
+#ifndef PROZ_LOG_COMPILE_LEVEL
+#define PROZ_LOG_COMPILE_LEVEL 0
+#endif
+
+enum class LogLevel
+{
+    DEBUG = 0,
+    INFO = 1,
+    WARN = 2,
+    ERROR = 3,
+    OFF = 4
+};
+
+// What a thread does when its log ring is full: drop the line, wait for the writer thread, or queue the line on
+// the heap until the writer catches up.
+enum class LogOverflow
+{
+    DROP,
+    BLOCK,
+    SPILL
+};
+
+// Fixed-size line formatter; arguments are only converted once the level is known to be enabled. The last byte
+// of the buffer is kept free for the newline the writer adds.
+class LogLine
+{
+public:
+    static const int CAPACITY = 256;
+
+    LogLine(char *buffer) : buf(buffer), len(0) {}
+
+    void append(const char *text) { appendRaw(text, std::strlen(text)); }
+    void append(const std::string &text) { appendRaw(text.data(), text.size()); }
+    void append(char c) { appendRaw(&c, 1); }
+    void append(bool value) { append(value ? "true" : "false"); }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type append(T value)
+    {
+        auto result = std::to_chars(buf + len, buf + CAPACITY - 1, value);
+        if (result.ec == std::errc())
+        {
+            len = static_cast<int>(result.ptr - buf);
+        }
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type append(T value)
+    {
+        append(static_cast<typename std::underlying_type<T>::type>(value));
+    }
+
+    int length() const { return len; }
+
+private:
+    char *buf;
+    int len;
+
+    void appendRaw(const char *text, size_t n)
+    {
+        size_t room = static_cast<size_t>(CAPACITY - 1 - len);
+        n = std::min(n, room);
+        std::memcpy(buf + len, text, n);
+        len += static_cast<int>(n);
+    }
+};
+
+// Asynchronous writer of log lines. Lines of one thread keep their order in the file; lines of different threads
+// are only ordered by their t= field.
+class Logger
+{
+public:
+    static Logger &instance();
+
+    void start(const std::string &file_path, LogLevel runtime_level, LogOverflow overflow_policy = LogOverflow::DROP);
+    void stop();
+    unsigned long long droppedLines() const { return dropped_lines.load(std::memory_order_relaxed); }
+
+    static LogLevel parseLevel(const std::string &name, LogLevel fallback);
+    static bool parseOverflow(const std::string &name, LogOverflow &policy);
+
+    static bool enabled(LogLevel level)
+    {
+        return static_cast<int>(level) >= PROZ_LOG_COMPILE_LEVEL &&
+               level >= instance().runtime_level.load(std::memory_order_relaxed);
+    }
+
+    template <typename... Args>
+    void write(LogLevel level, const Args &...args)
+    {
+        Ring *ring = localRing();
+        std::lock_guard<std::mutex> lock(ring->producer_mutex);
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        bool full = head - ring->tail.load(std::memory_order_acquire) >= RING_SLOTS;
+        while (full && overflow == LogOverflow::BLOCK && !terminate_writer_flag.load(std::memory_order_relaxed))
+        {
+            std::this_thread::yield();
+            full = head - ring->tail.load(std::memory_order_acquire) >= RING_SLOTS;
+        }
+        // Once a line has spilled, later ones follow it until the writer has taken the spill, to keep their order.
+        bool spill = overflow == LogOverflow::SPILL && (full || ring->spill_pending.load(std::memory_order_relaxed));
+        if (full && !spill)
+        {
+            dropped_lines.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        char spill_text[LogLine::CAPACITY];
+        Slot &slot = ring->slots[head % RING_SLOTS];
+        LogLine line(spill ? spill_text : slot.text);
+        line.append(levelTag(level));
+        line.append(" t=");
+        line.append(elapsedMicros());
+        line.append(' ');
+        (line.append(args), ...);
+        if (spill)
+        {
+            ring->spill.append(spill_text, line.length());
+            ring->spill.push_back('\n');
+            ring->spill_pending.store(true, std::memory_order_relaxed);
+            return;
+        }
+        slot.length = line.length();
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+private:
+    static const size_t RING_SLOTS = 1024;
+    // Threads share this many rings round-robin, which bounds the logger's memory however many threads log.
+    static const size_t RING_COUNT = 64;
+
+    struct Slot
+    {
+        int length;
+        char text[LogLine::CAPACITY];
+    };
+
+    // Producers take turns under producer_mutex; the writer thread is the single consumer. The spill holds
+    // newline-terminated lines that did not fit, and is guarded by producer_mutex too.
+    struct Ring
+    {
+        std::mutex producer_mutex;
+        std::atomic<size_t> head{0};
+        std::atomic<size_t> tail{0};
+        std::atomic<bool> spill_pending{false};
+        std::string spill;
+        Slot slots[RING_SLOTS];
+    };
+
+    Logger();
+
+    std::atomic<LogLevel> runtime_level;
+    LogOverflow overflow;
+    std::atomic<unsigned long long> dropped_lines;
+    std::atomic<bool> terminate_writer_flag;
+
+    std::mutex rings_mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    size_t threads_registered;
+
+    std::FILE *output;
+    std::thread writer_thread;
+
+    Ring *localRing();
+    Ring *registerRing();
+    bool drainRings();
+    bool drainRing(Ring &ring);
+    void runWriter();
+
+    static const char *levelTag(LogLevel level);
+    static long long elapsedMicros();
+};
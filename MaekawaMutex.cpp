@@ -0,0 +1,218 @@
+#include "MaekawaMutex.h"
+
+#include <cmath>
+
+namespace
+{
+    const std::pair<Timestamp, int> NOT_LOCKED = {0, 0};
+}
+
+MaekawaMutex::MaekawaMutex(int process_id, int n_procs, ClockManager &clock_mgr, MessageHandler &msg_handler)
+    : my_id(process_id), N_PROCESSES_CONST(n_procs), clock_manager(clock_mgr), message_handler(msg_handler),
+      requesting(false), request_ts(0), failed_received(false), locked_for(NOT_LOCKED), inquiry_sent(false)
+{
+    // Grid quorums: any two processes share the cells (row_a, col_b) and (row_b, col_a); an incomplete
+    // last row still intersects because two processes both in that row share the row itself.
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(n_procs))));
+    int my_index = my_id - 1;
+    int my_row = my_index / side;
+    int my_col = my_index % side;
+    for (int index = 0; index < n_procs; ++index)
+    {
+        if (index / side == my_row || index % side == my_col)
+        {
+            quorum.push_back(index + 1);
+        }
+    }
+    log(LogLevel::INFO, "Quorum of size ", quorum.size(), " on a ", side, "x", side, " grid.");
+}
+
+void MaekawaMutex::sendTo(int target_id, MessageType type, Timestamp ts)
+{
+    message_handler.sendMessage(target_id - 1, type, ts);
+}
+
+void MaekawaMutex::request(Timestamp ts)
+{
+    requesting = true;
+    request_ts = ts;
+    failed_received = false;
+    pending_inquiries.clear();
+    grants_needed.clear();
+    for (int member : quorum)
+    {
+        grants_needed.insert(member);
+    }
+    log(LogLevel::DEBUG, "Requesting quorum with ts ", request_ts, ". Expecting ", grants_needed.size(), " votes.");
+    for (int member : quorum)
+    {
+        sendTo(member, MessageType::MAEKAWA_REQUEST, request_ts);
+    }
+}
+
+void MaekawaMutex::release()
+{
+    log(LogLevel::DEBUG, "Releasing quorum for ts ", request_ts);
+    requesting = false;
+    pending_inquiries.clear();
+    for (int member : quorum)
+    {
+        sendTo(member, MessageType::MAEKAWA_RELEASE, request_ts);
+    }
+}
+
+void MaekawaMutex::handleMessage(const Message &msg)
+{
+    switch (msg.type)
+    {
+    case MessageType::MAEKAWA_REQUEST:
+        handleRequest(msg);
+        break;
+    case MessageType::MAEKAWA_LOCKED:
+        handleLocked(msg);
+        break;
+    case MessageType::MAEKAWA_FAILED:
+        handleFailed(msg);
+        break;
+    case MessageType::MAEKAWA_INQUIRE:
+        handleInquire(msg);
+        break;
+    case MessageType::MAEKAWA_RELINQUISH:
+        handleRelinquish(msg);
+        break;
+    case MessageType::MAEKAWA_RELEASE:
+        handleRelease(msg);
+        break;
+    default:
+        break;
+    }
+}
+
+// Arbiter side.
+void MaekawaMutex::handleRequest(const Message &msg)
+{
+    std::pair<Timestamp, int> incoming = {msg.timestamp, msg.sender_id};
+    if (locked_for == NOT_LOCKED)
+    {
+        locked_for = incoming;
+        log(LogLevel::DEBUG, "Voting for ", msg.sender_id, " (ts:", msg.timestamp, ")");
+        sendTo(msg.sender_id, MessageType::MAEKAWA_LOCKED, msg.timestamp);
+        return;
+    }
+
+    bool precedes_everyone = incoming < locked_for &&
+                             (waiting_requests.empty() || incoming < *waiting_requests.begin());
+
+    if (!precedes_everyone)
+    {
+        waiting_requests.insert(incoming);
+        log(LogLevel::DEBUG, "Vote held by ", locked_for.second, "; FAILED to ", msg.sender_id);
+        sendTo(msg.sender_id, MessageType::MAEKAWA_FAILED, msg.timestamp);
+        return;
+    }
+
+    // The previous head of the queue may never have been told it lost; without FAILED it would keep
+    // deferring INQUIREs from its other arbiters while waiting behind the new request.
+    if (!waiting_requests.empty() && incoming < locked_for)
+    {
+        const std::pair<Timestamp, int> &displaced = *waiting_requests.begin();
+        sendTo(displaced.second, MessageType::MAEKAWA_FAILED, displaced.first);
+    }
+    waiting_requests.insert(incoming);
+
+    if (!inquiry_sent)
+    {
+        log(LogLevel::DEBUG, msg.sender_id, " outranks vote holder ", locked_for.second, "; sending INQUIRE.");
+        inquiry_sent = true;
+        sendTo(locked_for.second, MessageType::MAEKAWA_INQUIRE, locked_for.first);
+    }
+}
+
+void MaekawaMutex::handleRelinquish(const Message &msg)
+{
+    if (locked_for != std::make_pair(msg.timestamp, msg.sender_id))
+    {
+        log(LogLevel::WARN, "Ignoring RELINQUISH from ", msg.sender_id, " that does not hold the vote.");
+        return;
+    }
+    waiting_requests.insert(locked_for);
+    grantNextWaiting();
+}
+
+void MaekawaMutex::handleRelease(const Message &msg)
+{
+    if (locked_for.second != msg.sender_id)
+    {
+        log(LogLevel::WARN, "Ignoring RELEASE from ", msg.sender_id, " that does not hold the vote.");
+        return;
+    }
+    locked_for = NOT_LOCKED;
+    grantNextWaiting();
+}
+
+void MaekawaMutex::grantNextWaiting()
+{
+    inquiry_sent = false;
+    if (waiting_requests.empty())
+    {
+        locked_for = NOT_LOCKED;
+        return;
+    }
+    locked_for = *waiting_requests.begin();
+    waiting_requests.erase(waiting_requests.begin());
+    log(LogLevel::DEBUG, "Voting for waiting ", locked_for.second, " (ts:", locked_for.first, ")");
+    sendTo(locked_for.second, MessageType::MAEKAWA_LOCKED, locked_for.first);
+}
+// Requester side.
+void MaekawaMutex::handleLocked(const Message &msg)
+{
+    if (!requesting || msg.timestamp != request_ts)
+    {
+        log(LogLevel::WARN, "Stale LOCKED from ", msg.sender_id, " (ts:", msg.timestamp, ")");
+        return;
+    }
+    grants_needed.erase(msg.sender_id);
+    log(LogLevel::DEBUG, "Vote from ", msg.sender_id, ". Remaining: ", grants_needed.size());
+}
+
+void MaekawaMutex::handleFailed(const Message &msg)
+{
+    if (!requesting || msg.timestamp != request_ts)
+    {
+        return;
+    }
+    failed_received = true;
+    for (int arbiter_id : pending_inquiries)
+    {
+        relinquishTo(arbiter_id);
+    }
+    pending_inquiries.clear();
+}
+
+void MaekawaMutex::handleInquire(const Message &msg)
+{
+    // Once every vote is in we are (or are about to be) in the CS; RELEASE will answer the inquiry.
+    if (!requesting || msg.timestamp != request_ts || isGranted() || grants_needed.contains(msg.sender_id))
+    {
+        return;
+    }
+    if (failed_received)
+    {
+        relinquishTo(msg.sender_id);
+    }
+    else
+    {
+        pending_inquiries.push_back(msg.sender_id);
+    }
+}
+
+void MaekawaMutex::relinquishTo(int arbiter_id)
+{
+    if (grants_needed.contains(arbiter_id))
+    {
+        return;
+    }
+    log(LogLevel::DEBUG, "Relinquishing vote of ", arbiter_id);
+    grants_needed.insert(arbiter_id);
+    sendTo(arbiter_id, MessageType::MAEKAWA_RELINQUISH, request_ts);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <set>
+#include <vector>
+#include <utility>
+
+#include "types.h"
+#include "Logger.h"
+#include "ClockManager.h"
+#include "MessageHandler.h"
+#include "PeerSet.h"
+
+// Maekawa's quorum mutual exclusion over a sqrt(N) x sqrt(N) grid (quorum = own row + own column).
+// Every process is both a requester and an arbiter for the processes whose quorum contains it.
+// INQUIRE/RELINQUISH/FAILED follow Maekawa's rules so that conflicting grants cannot deadlock.
+// Like the token and pool-wide Ricart-Agrawala, it locks the whole house pool, and the holder keeps the lock until
+// it releases its house. Only one house is occupied at a time, so compare it with the pool lock, not with per-house
+// Ricart-Agrawala. Releasing early is unsafe here: the next holder hears from arbiters, not from the previous
+// holder, so it could choose a house before that holder's UPDATE_HOUSE_STATE arrives.
+class MaekawaMutex
+{
+public:
+    MaekawaMutex(int process_id, int n_procs, ClockManager &clock_mgr, MessageHandler &msg_handler);
+
+    void request(Timestamp request_ts);
+    void release();
+    bool isGranted() const { return requesting && grants_needed.empty(); }
+    void handleMessage(const Message &msg);
+
+    const std::vector<int> &getQuorum() const { return quorum; }
+
+private:
+    int my_id;
+    const int N_PROCESSES_CONST;
+    ClockManager &clock_manager;
+    MessageHandler &message_handler;
+
+    std::vector<int> quorum;
+
+    // Requester state
+    bool requesting;
+    Timestamp request_ts;
+    PeerSet grants_needed;
+    bool failed_received;
+    std::vector<int> pending_inquiries;
+
+    // Arbiter state: the request this process has voted for, and the ones waiting for its vote.
+    std::pair<Timestamp, int> locked_for;
+    bool inquiry_sent;
+    std::set<std::pair<Timestamp, int>> waiting_requests;
+
+    void handleRequest(const Message &msg);
+    void handleLocked(const Message &msg);
+    void handleFailed(const Message &msg);
+    void handleInquire(const Message &msg);
+    void handleRelinquish(const Message &msg);
+    void handleRelease(const Message &msg);
+
+    void relinquishTo(int arbiter_id);
+    void grantNextWaiting();
+    void sendTo(int target_id, MessageType type, Timestamp ts);
+
+    template <typename... Args>
+    void log(LogLevel level, const Args &...args) const
+    {
+        if (Logger::enabled(level))
+        {
+            Logger::instance().write(level, "[Maekawa P", my_id, " C", clock_manager.getTime(), "] ", args...);
+        }
+    }
+};
@@ -1,80 +1,460 @@
 #include "MessageHandler.h"
 #include "ProcessLogic.h"
 
-MessageHandler::MessageHandler(int process_id, int mpi_rank, int total_processes, ClockManager &clock_mgr)
-    : my_id(process_id), my_rank(mpi_rank), N_PROCESSES_CONST(total_processes), clock_manager(clock_mgr), terminate_listening_flag(false) {}
+MessageHandler::MessageHandler(int process_id, const SimConfig &config, ClockManager &clock_mgr, Transport &transport_ref,
+                               Metrics &metrics_ref)
+    : my_id(process_id), my_rank(transport_ref.rank()), N_PROCESSES_CONST(config.n_processes), clock_manager(clock_mgr),
+      transport(transport_ref), metrics(metrics_ref), terminate_listening_flag(false),
+      // Largest payloads: the Suzuki-Kasami token (LN[N], queue length, queue[N]) or a house reply
+      // (echoed request timestamp, then a version vector of 3 words per house).
+      max_message_words(HEADER_WORDS + std::max(config.house_algorithm == MutexAlgorithm::SUZUKI_KASAMI ? 2 * config.n_processes + 1 : 0,
+                                                TIMESTAMP_WORDS + 3 * config.d_houses)),
+      max_batch_words(std::max(BATCH_WORDS_LIMIT, 1 + max_message_words)),
+      heartbeat_period(config.heartbeat_ms),
+      silent_periods(config.heartbeat_ms > 0 ? config.n_processes + 1 : 0, 0),
+      terminate_sending_flag(false), messages_sent(0), batches_sent(0),
+      traced_own_request_ts{0, 0},
+      traced_peer_request_ts(Tracer::enabled() ? 2 * (config.n_processes + 1) : 0)
+{
+    sent_this_period.reset(config.n_processes, 0);
+    sent_this_period.clear();
+    heard_this_period = sent_this_period;
+    suspected_peers = sent_this_period;
+}
 
-void MessageHandler::log(const std::string &message_content)
+void MessageHandler::appendMessage(int target_rank, MessageType type, Timestamp timestamp, int h_id, int h_status,
+                                   const std::vector<int> &payload)
 {
-    std::cout << "[MsgHandler P" << my_id << " C" << clock_manager.getTime() << "] " << message_content << std::endl;
+    std::vector<int> &batch = pending_batches[target_rank];
+    int message_words = HEADER_WORDS + static_cast<int>(payload.size());
+    // A non-empty batch always has its rank in pending_ranks, so a rank whose full batch was just queued is
+    // still listed there.
+    bool rank_pending = !batch.empty();
+    if (rank_pending && static_cast<int>(batch.size()) + message_words > max_batch_words)
+    {
+        flushRankLocked(target_rank);
+        outbound_cv.notify_one();
+    }
+    if (batch.empty())
+    {
+        if (pending_ranks.empty())
+        {
+            // The send thread may be in its untimed wait; it has to start the COALESCE_WINDOW clock.
+            pending_since = std::chrono::steady_clock::now();
+            outbound_cv.notify_one();
+        }
+        if (!rank_pending)
+        {
+            pending_ranks.push_back(target_rank);
+        }
+        batch.push_back(0);
+    }
+
+    batch[0]++;
+    encodeMessage(batch, type, my_id, timestamp, h_id, h_status, payload);
+    if (failureDetectorEnabled())
+    {
+        sent_this_period.insert(target_rank + 1);
+    }
+    messages_sent++;
+    metrics.countSent(type);
+    if (Tracer::enabled())
+    {
+        traceSend(target_rank + 1, type, timestamp);
+    }
 }
 
-void MessageHandler::sendMessage(int target_mpi_rank, MessageType type, int custom_ts, int h_id, int h_status)
+void MessageHandler::encodeMessage(std::vector<int> &words, MessageType type, int sender_id, Timestamp timestamp,
+                                   int h_id, int h_status, const std::vector<int> &payload)
 {
-    clock_manager.increment();
-    int send_timestamp = (custom_ts != -1) ? custom_ts : clock_manager.getTime();
+    words.push_back(static_cast<int>(type));
+    words.push_back(sender_id);
+    appendTimestamp(words, timestamp);
+    words.push_back(h_id);
+    words.push_back(h_status);
+    words.push_back(static_cast<int>(payload.size()));
+    words.insert(words.end(), payload.begin(), payload.end());
+}
 
-    int buf[5];
-    buf[0] = static_cast<int>(type);
-    buf[1] = my_id;
-    buf[2] = send_timestamp;
-    buf[3] = h_id;
-    buf[4] = h_status;
-    MPI_Send(buf, 5, MPI_INT, target_mpi_rank, 0, MPI_COMM_WORLD);
+// RA replies and Maekawa grants continue the flow of the request they answer; everything else is a send/receive pair.
+void MessageHandler::traceSend(int target_id, MessageType type, Timestamp timestamp)
+{
+    Tracer::FlowPhase phase = Tracer::FlowPhase::START;
+    unsigned long long flow_id = Tracer::flowId(my_id, target_id, type, timestamp);
+    switch (type)
+    {
+    case MessageType::REQUEST_HOUSE:
+    case MessageType::REQUEST_PASER:
+        traced_own_request_ts[type == MessageType::REQUEST_PASER] = timestamp;
+        break;
+    case MessageType::REPLY_HOUSE:
+    case MessageType::REPLY_PASER:
+    case MessageType::HOUSE_BUSY:
+    {
+        bool paser = type == MessageType::REPLY_PASER;
+        Timestamp request_ts = traced_peer_request_ts[2 * target_id + paser];
+        phase = Tracer::FlowPhase::STEP;
+        flow_id = Tracer::flowId(target_id, my_id, paser ? MessageType::REQUEST_PASER : MessageType::REQUEST_HOUSE, request_ts);
+        break;
+    }
+    case MessageType::MAEKAWA_LOCKED:
+        phase = Tracer::FlowPhase::STEP;
+        flow_id = Tracer::flowId(target_id, my_id, MessageType::MAEKAWA_REQUEST, timestamp);
+        break;
+    default:
+        break;
+    }
+    Tracer::instance().recordMessage(my_id, true, target_id, type, clock_manager.getTime(), phase, flow_id);
 }
 
-void MessageHandler::broadcastMessage(MessageType type, int custom_ts, int h_id, int h_status)
+void MessageHandler::traceReceive(const Message &msg)
 {
-    clock_manager.increment();
-    int broadcast_timestamp = (custom_ts != -1) ? custom_ts : clock_manager.getTime();
+    Tracer::FlowPhase phase = Tracer::FlowPhase::FINISH;
+    unsigned long long flow_id = Tracer::flowId(msg.sender_id, my_id, msg.type, msg.timestamp);
+    switch (msg.type)
+    {
+    case MessageType::REQUEST_HOUSE:
+    case MessageType::REQUEST_PASER:
+        traced_peer_request_ts[2 * msg.sender_id + (msg.type == MessageType::REQUEST_PASER)] = msg.timestamp;
+        phase = Tracer::FlowPhase::STEP;
+        break;
+    case MessageType::MAEKAWA_REQUEST:
+        phase = Tracer::FlowPhase::STEP;
+        break;
+    case MessageType::REPLY_HOUSE:
+    case MessageType::REPLY_PASER:
+    case MessageType::HOUSE_BUSY:
+    {
+        bool paser = msg.type == MessageType::REPLY_PASER;
+        flow_id = Tracer::flowId(my_id, msg.sender_id, paser ? MessageType::REQUEST_PASER : MessageType::REQUEST_HOUSE,
+                                 traced_own_request_ts[paser]);
+        break;
+    }
+    case MessageType::MAEKAWA_LOCKED:
+        flow_id = Tracer::flowId(my_id, msg.sender_id, MessageType::MAEKAWA_REQUEST, msg.timestamp);
+        break;
+    default:
+        break;
+    }
+    Tracer::instance().recordMessage(my_id, false, msg.sender_id, msg.type, clock_manager.getTime(), phase, flow_id);
+}
 
+void MessageHandler::flushRankLocked(int target_rank)
+{
+    std::vector<int> &batch = pending_batches[target_rank];
+    if (batch.empty())
+    {
+        return;
+    }
+    outbound_queue.push_back({target_rank, std::move(batch)});
+    batch.clear();
+    batches_sent++;
+}
+
+void MessageHandler::flushLocked()
+{
+    for (int rank : pending_ranks)
+    {
+        flushRankLocked(rank);
+    }
+    pending_ranks.clear();
+}
+
+void MessageHandler::flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(outbound_mutex);
+        if (pending_ranks.empty())
+        {
+            return;
+        }
+        flushLocked();
+    }
+    outbound_cv.notify_one();
+}
+
+void MessageHandler::sendPendingNow()
+{
+    std::vector<TransportBatch> ready;
+    {
+        std::lock_guard<std::mutex> lock(outbound_mutex);
+        flushLocked();
+        ready.swap(outbound_queue);
+    }
+    if (!ready.empty())
+    {
+        transport.sendBatches(ready);
+    }
+}
+
+void MessageHandler::sendMessage(int target_rank, MessageType type, Timestamp custom_ts, int h_id, int h_status,
+                                 const std::vector<int> &payload)
+{
+    Timestamp now = clock_manager.tick();
+    Timestamp send_timestamp = (custom_ts != -1) ? custom_ts : now;
+
+    std::lock_guard<std::mutex> lock(outbound_mutex);
+    appendMessage(target_rank, type, send_timestamp, h_id, h_status, payload);
+}
+
+void MessageHandler::broadcastMessage(MessageType type, Timestamp custom_ts, int h_id, int h_status,
+                                      const std::vector<int> &payload)
+{
+    Timestamp now = clock_manager.tick();
+    Timestamp broadcast_timestamp = (custom_ts != -1) ? custom_ts : now;
+
+    std::lock_guard<std::mutex> lock(outbound_mutex);
     for (int i = 0; i < N_PROCESSES_CONST; ++i)
     {
         if (i != my_rank)
         {
-            int buf[5];
-            buf[0] = static_cast<int>(type);
-            buf[1] = my_id;
-            buf[2] = broadcast_timestamp;
-            buf[3] = h_id;
-            buf[4] = h_status;
-            MPI_Send(buf, 5, MPI_INT, i, 0, MPI_COMM_WORLD);
+            appendMessage(i, type, broadcast_timestamp, h_id, h_status, payload);
         }
     }
 }
 
-void MessageHandler::listenForMessages(ProcessLogic *logic_ptr)
+void MessageHandler::runSendLoop()
+{
+    std::vector<TransportBatch> in_flight;
+    bool sends_in_flight = false;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(outbound_mutex);
+            // Waking when the first message is appended lets an idle thread pick up the COALESCE_WINDOW deadline.
+            bool had_pending = !pending_ranks.empty();
+            auto ready = [this, had_pending]()
+            { return !outbound_queue.empty() || terminate_sending_flag || (!had_pending && !pending_ranks.empty()); };
+            auto deadline = std::chrono::steady_clock::time_point::max();
+            if (!pending_ranks.empty())
+            {
+                deadline = pending_since + COALESCE_WINDOW;
+            }
+            if (sends_in_flight)
+            {
+                deadline = std::min(deadline, std::chrono::steady_clock::now() + SEND_REAP_INTERVAL);
+            }
+            if (deadline == std::chrono::steady_clock::time_point::max())
+            {
+                outbound_cv.wait(lock, ready);
+            }
+            else
+            {
+                outbound_cv.wait_until(lock, deadline, ready);
+            }
+
+            // Batches nobody flushed explicitly still go out once they are COALESCE_WINDOW old.
+            if (!pending_ranks.empty() &&
+                (terminate_sending_flag || std::chrono::steady_clock::now() >= pending_since + COALESCE_WINDOW))
+            {
+                flushLocked();
+            }
+            if (outbound_queue.empty() && terminate_sending_flag)
+            {
+                break;
+            }
+            in_flight.swap(outbound_queue);
+        }
+
+        if (!in_flight.empty())
+        {
+            transport.sendBatches(in_flight);
+            in_flight.clear();
+        }
+        sends_in_flight = transport.reapSends();
+    }
+    transport.waitSends();
+}
+
+void MessageHandler::stopSending()
+{
+    {
+        std::lock_guard<std::mutex> lock(outbound_mutex);
+        terminate_sending_flag = true;
+    }
+    outbound_cv.notify_one();
+}
+
+void MessageHandler::startTerminationBarrier()
+{
+    transport.startBarrier();
+}
+
+bool MessageHandler::terminationBarrierDone()
+{
+    return transport.testBarrier();
+}
+
+void MessageHandler::waitTerminationBarrier()
 {
-    MPI_Status status;
-    int buf[5];
+    transport.waitBarrier();
+}
+
+void MessageHandler::decodeBatch(const int *batch, std::vector<Message> &messages)
+{
+    int message_count = batch[0];
+    const int *cursor = batch + 1;
 
-    while (!terminate_listening_flag.load())
+    messages.resize(message_count);
+    for (Message &msg : messages)
     {
-        int flag = 0;
-        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+        msg.type = static_cast<MessageType>(cursor[0]);
+        msg.sender_id = cursor[1];
+        msg.timestamp = readTimestamp(cursor + 2);
+        const int *rest = cursor + 2 + TIMESTAMP_WORDS;
+        msg.house_id = rest[0];
+        msg.new_house_status = rest[1];
+        msg.payload.assign(cursor + HEADER_WORDS, cursor + HEADER_WORDS + rest[2]);
+        cursor += HEADER_WORDS + rest[2];
+    }
 
-        if (flag)
+    // The buffer is free as soon as the batch is decoded; keep the receive ring full while we process.
+    transport.releaseBatch();
+}
+
+bool MessageHandler::batchFits(const int *batch, size_t batch_words)
+{
+    if (batch_words < 1 || batch[0] < 0)
+    {
+        return false;
+    }
+    size_t cursor = 1;
+    for (int i = 0; i < batch[0]; ++i)
+    {
+        if (batch_words - cursor < static_cast<size_t>(HEADER_WORDS))
         {
-            MPI_Recv(buf, 5, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &status);
-            Message msg;
-            msg.type = static_cast<MessageType>(buf[0]);
-            msg.sender_id = buf[1];
-            msg.timestamp = buf[2];
-            msg.house_id = buf[3];
-            msg.new_house_status = buf[4];
+            return false;
+        }
+        int payload_words = batch[cursor + 2 + TIMESTAMP_WORDS + 2];
+        if (payload_words < 0 || batch_words - cursor - HEADER_WORDS < static_cast<size_t>(payload_words))
+        {
+            return false;
+        }
+        cursor += HEADER_WORDS + payload_words;
+    }
+    return true;
+}
 
-            clock_manager.updateOnReceive(msg.timestamp);
+void MessageHandler::applyMessages(const std::vector<Message> &messages, ProcessLogic *logic_ptr)
+{
+    // Messages are applied in send order so Lamport clock updates match the unbatched protocol.
+    for (const Message &msg : messages)
+    {
+        if (recorder)
+        {
+            // A one-message batch, so a replay goes through decodeBatch like any received batch.
+            std::vector<int> &words = recorder->beginMessage(1 + HEADER_WORDS + static_cast<int>(msg.payload.size()));
+            words.push_back(1);
+            encodeMessage(words, msg.type, msg.sender_id, msg.timestamp, msg.house_id, msg.new_house_status, msg.payload);
+            recorder->endMessage();
+        }
+        clock_manager.updateOnReceive(msg.timestamp);
+        metrics.countReceived(msg.type);
+        if (failureDetectorEnabled())
+        {
+            heard_this_period.insert(msg.sender_id);
+        }
+        if (Tracer::enabled())
+        {
+            traceReceive(msg);
+        }
 
-            if (logic_ptr)
+        if (logic_ptr)
+        {
+            logic_ptr->processIncomingMessage(msg);
+        }
+    }
+}
+
+std::chrono::steady_clock::time_point MessageHandler::pollFailureDetector(std::chrono::steady_clock::time_point now,
+                                                                        std::vector<int> &suspected_now)
+{
+    if (!failureDetectorEnabled())
+    {
+        return std::chrono::steady_clock::time_point::max();
+    }
+    if (next_heartbeat == std::chrono::steady_clock::time_point{})
+    {
+        next_heartbeat = now + heartbeat_period;
+    }
+    if (now < next_heartbeat)
+    {
+        return next_heartbeat;
+    }
+
+    for (int id = 1; id <= N_PROCESSES_CONST; ++id)
+    {
+        if (id == my_id)
+        {
+            continue;
+        }
+        if (heard_this_period.contains(id))
+        {
+            silent_periods[id] = 0;
+            if (suspected_peers.contains(id))
             {
-                logic_ptr->processIncomingMessage(msg);
+                suspected_peers.erase(id);
+                log(LogLevel::WARN, "Heard from suspected peer ", id, " again.");
             }
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        else if (++silent_periods[id] == SUSPECT_PERIODS)
+        {
+            suspected_peers.insert(id);
+            suspected_now.push_back(id);
+            metrics.countPeerSuspected();
+            log(LogLevel::WARN, "Suspecting peer ", id, " after ", SUSPECT_PERIODS, " silent heartbeat periods.");
+        }
+        if (!sent_this_period.contains(id))
+        {
+            sendMessage(id - 1, MessageType::HEARTBEAT);
+        }
+    }
+    sent_this_period.clear();
+    heard_this_period.clear();
+    next_heartbeat = now + heartbeat_period;
+    return next_heartbeat;
+}
+
+bool MessageHandler::startRecording(const std::string &path, const SimConfig &config)
+{
+    recorder = std::make_unique<ReplayRecorder>(path, my_id, config);
+    if (!recorder->isOpen())
+    {
+        log(LogLevel::ERROR, "Cannot open replay log ", path);
+        recorder.reset();
+        return false;
     }
+    return true;
+}
+
+void MessageHandler::dispatchBatch(const int *batch, ProcessLogic *logic_ptr)
+{
+    decodeBatch(batch, decoded_messages);
+    applyMessages(decoded_messages, logic_ptr);
+}
+
+void MessageHandler::listenForMessages(ProcessLogic *logic_ptr)
+{
+    transport.startReceiving(max_batch_words);
+
+    while (!terminate_listening_flag.load() && transport.waitForBatches())
+    {
+        // Drain everything that is already here before blocking again. The protocol thread applies the
+        // messages, so the listener never touches protocol state and never waits for it.
+        while (const int *batch = transport.nextBatch())
+        {
+            std::vector<Message> messages;
+            decodeBatch(batch, messages);
+            logic_ptr->enqueueMessages(std::move(messages));
+        }
+    }
+
+    transport.stopReceiving();
 }
 
 void MessageHandler::stopListening()
 {
     terminate_listening_flag = true;
+    transport.wakeReceiver();
 }
@@ -1,30 +1,137 @@
 #pragma once
 
-#include <mpi.h>
 #include <string>
 #include <iostream> 
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
 
 #include "types.h"
+#include "Logger.h"
 #include "ClockManager.h"
+#include "Transport.h"
+#include "Metrics.h"
+#include "Tracer.h"
+#include "ReplayLog.h"
+#include "PeerSet.h"
 
 class ProcessLogic;
 
 class MessageHandler
 {
 public:
-    MessageHandler(int process_id, int mpi_rank, int total_processes, ClockManager &clock_mgr);
+    MessageHandler(int process_id, const SimConfig &config, ClockManager &clock_mgr, Transport &transport, Metrics &metrics);
 
-    void sendMessage(int target_mpi_rank, MessageType type, int custom_ts = -1, int h_id = 0, int h_status = 0);
-    void broadcastMessage(MessageType type, int custom_ts = -1, int h_id = 0, int h_status = 0);
+    void sendMessage(int target_rank, MessageType type, Timestamp custom_ts = -1, int h_id = 0, int h_status = 0,
+                     const std::vector<int> &payload = {});
+    void broadcastMessage(MessageType type, Timestamp custom_ts = -1, int h_id = 0, int h_status = 0,
+                          const std::vector<int> &payload = {});
     void listenForMessages(ProcessLogic *logic_ptr);
     void stopListening();
+    void runSendLoop();
+    void stopSending();
+    void flush();
+    // For drivers without a send thread: flush and hand every batch to the transport on the calling thread.
+    void sendPendingNow();
+    // Decodes one received batch and applies its messages at once, for drivers that deliver batches themselves.
+    void dispatchBatch(const int *batch, ProcessLogic *logic_ptr);
+    // True if a batch of batch_words words decodes without reading past its end, for batches from a file.
+    static bool batchFits(const int *batch, size_t batch_words);
+    // Updates the clock, counters and trace for each message and hands it to the protocol; protocol thread only.
+    void applyMessages(const std::vector<Message> &messages, ProcessLogic *logic_ptr);
+    void startTerminationBarrier();
+    bool terminationBarrierDone();
+    void waitTerminationBarrier();
+    long long getMessagesSent() const { return messages_sent.load(); }
+
+    // Failure detector, protocol thread only and off unless config.heartbeat_ms > 0. Every received message
+    // counts as a heartbeat, and a peer this process sent nothing to during a heartbeat period gets an explicit
+    // HEARTBEAT. A peer silent for SUSPECT_PERIODS periods is suspected until it is heard from again.
+    // Appends the peers newly suspected by this call and returns when it must be called next.
+    std::chrono::steady_clock::time_point pollFailureDetector(std::chrono::steady_clock::time_point now,
+                                                              std::vector<int> &suspected_now);
+    bool failureDetectorEnabled() const { return heartbeat_period.count() > 0; }
+    const PeerSet &suspectedPeers() const { return suspected_peers; }
+
+    // Optional replay log of every applied message and every timed step of the protocol thread.
+    bool startRecording(const std::string &path, const SimConfig &config);
+    void stopRecording() { recorder.reset(); }
+    void recordTime(ReplayRecord kind, std::chrono::steady_clock::time_point now)
+    {
+        if (recorder)
+        {
+            recorder->recordTime(kind, now);
+        }
+    }
+    long long getBatchesSent() const { return batches_sent.load(); }
 
 private:
+    // Wire layout: type, sender, timestamp (TIMESTAMP_WORDS), house id, house status, payload length, payload...
+    static const int HEADER_WORDS = 5 + TIMESTAMP_WORDS;
+    // Coalescing: messages to one destination are packed as [count, message, message, ...] into one transport batch.
+    static constexpr int BATCH_WORDS_LIMIT = 1024;
+    static constexpr std::chrono::microseconds COALESCE_WINDOW{500};
+    // While the transport still has sends in flight, the send thread checks on them at least this often.
+    static constexpr std::chrono::microseconds SEND_REAP_INTERVAL{200};
+
     int my_id;
     int my_rank;
     int N_PROCESSES_CONST;
     ClockManager &clock_manager;
+    Transport &transport;
+    Metrics &metrics;
     std::atomic<bool> terminate_listening_flag;
+    const int max_message_words;
+    const int max_batch_words;
+
+    std::vector<Message> decoded_messages;
+
+    static constexpr int SUSPECT_PERIODS = 4;
+    const std::chrono::milliseconds heartbeat_period;
+    std::chrono::steady_clock::time_point next_heartbeat;
+    PeerSet sent_this_period;
+    PeerSet heard_this_period;
+    PeerSet suspected_peers;
+    std::vector<int> silent_periods; // by process id; empty while the failure detector is off
+    std::unique_ptr<ReplayRecorder> recorder;
+
+    // Outbound path: protocol code appends to a per-destination batch; flush() (end of a protocol step),
+    // a full batch or COALESCE_WINDOW moves batches to the queue that the send thread hands to the transport.
+    // Keyed by rank so an in-process run with thousands of ranks does not pay for N*N empty vectors.
+    std::unordered_map<int, std::vector<int>> pending_batches;
+    std::vector<int> pending_ranks;
+    std::chrono::steady_clock::time_point pending_since;
+    std::vector<TransportBatch> outbound_queue;
+    std::mutex outbound_mutex;
+    std::condition_variable outbound_cv;
+    bool terminate_sending_flag;
+    std::atomic<long long> messages_sent;
+    std::atomic<long long> batches_sent;
+
+    // Trace flow ids tie a REQUEST to the REPLY that answers it. The requester remembers its own request
+    // timestamps; the replier remembers the last request timestamp per peer and resource (index 2 * id + resource).
+    Timestamp traced_own_request_ts[2];
+    std::vector<Timestamp> traced_peer_request_ts;
 
-    void log(const std::string &message_content);
+    template <typename... Args>
+    void log(LogLevel level, const Args &...args) const
+    {
+        if (Logger::enabled(level))
+        {
+            Logger::instance().write(level, "[MsgHandler P", my_id, " C", clock_manager.getTime(), "] ", args...);
+        }
+    }
+    void appendMessage(int target_rank, MessageType type, Timestamp timestamp, int h_id, int h_status,
+                       const std::vector<int> &payload);
+    static void encodeMessage(std::vector<int> &words, MessageType type, int sender_id, Timestamp timestamp, int h_id,
+                              int h_status, const std::vector<int> &payload);
+    void traceSend(int target_id, MessageType type, Timestamp timestamp);
+    void traceReceive(const Message &msg);
+    void decodeBatch(const int *batch, std::vector<Message> &messages);
+    void flushRankLocked(int target_rank);
+    void flushLocked();
 };
@@ -0,0 +1,186 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+
+static void updateMax(std::atomic<unsigned long long> &target, unsigned long long value)
+{
+    unsigned long long current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot &other)
+{
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum_us += other.sum_us;
+    max_us = std::max(max_us, other.max_us);
+}
+
+unsigned long long HistogramSnapshot::percentileUs(double p) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    unsigned long long rank = static_cast<unsigned long long>(p * (count - 1)) + 1;
+    unsigned long long seen = 0;
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return std::min(1ULL << i, max_us);
+        }
+    }
+    return max_us;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds duration)
+{
+    unsigned long long us = duration.count() > 0 ? static_cast<unsigned long long>(duration.count() / 1000) : 0;
+    int bucket = us == 0 ? 0 : std::min(64 - __builtin_clzll(us), HistogramSnapshot::BUCKETS - 1);
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum_us.fetch_add(us, std::memory_order_relaxed);
+    updateMax(max_us, us);
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const
+{
+    HistogramSnapshot copy;
+    for (int i = 0; i < HistogramSnapshot::BUCKETS; ++i)
+    {
+        copy.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    copy.count = count.load(std::memory_order_relaxed);
+    copy.sum_us = sum_us.load(std::memory_order_relaxed);
+    copy.max_us = max_us.load(std::memory_order_relaxed);
+    return copy;
+}
+
+void MetricsSnapshot::merge(const MetricsSnapshot &other)
+{
+    for (int i = 0; i < MESSAGE_TYPE_COUNT; ++i)
+    {
+        sent[i] += other.sent[i];
+        received[i] += other.received[i];
+    }
+    no_free_house_retries += other.no_free_house_retries;
+    house_deferred_high_water = std::max(house_deferred_high_water, other.house_deferred_high_water);
+    paser_deferred_high_water = std::max(paser_deferred_high_water, other.paser_deferred_high_water);
+    peers_suspected += other.peers_suspected;
+    request_timeouts += other.request_timeouts;
+    want_house.merge(other.want_house);
+    want_paser.merge(other.want_paser);
+    house_reply_rtt.merge(other.house_reply_rtt);
+    paser_reply_rtt.merge(other.paser_reply_rtt);
+    queueing_delay.merge(other.queueing_delay);
+}
+
+void Metrics::observeDeferredDepth(ResourceType type, size_t depth)
+{
+    updateMax(type == ResourceType::HOUSE_RESOURCE ? house_deferred_high_water : paser_deferred_high_water, depth);
+}
+
+MetricsSnapshot Metrics::snapshot() const
+{
+    MetricsSnapshot copy;
+    for (int i = 0; i < MESSAGE_TYPE_COUNT; ++i)
+    {
+        copy.sent[i] = sent[i].load(std::memory_order_relaxed);
+        copy.received[i] = received[i].load(std::memory_order_relaxed);
+    }
+    copy.no_free_house_retries = no_free_house_retries.load(std::memory_order_relaxed);
+    copy.house_deferred_high_water = house_deferred_high_water.load(std::memory_order_relaxed);
+    copy.paser_deferred_high_water = paser_deferred_high_water.load(std::memory_order_relaxed);
+    copy.peers_suspected = peers_suspected.load(std::memory_order_relaxed);
+    copy.request_timeouts = request_timeouts.load(std::memory_order_relaxed);
+    copy.want_house = want_house.snapshot();
+    copy.want_paser = want_paser.snapshot();
+    copy.house_reply_rtt = house_reply_rtt.snapshot();
+    copy.paser_reply_rtt = paser_reply_rtt.snapshot();
+    copy.queueing_delay = queueing_delay.snapshot();
+    return copy;
+}
+
+static void writeMessageCounts(FILE *out, const char *name, const std::array<unsigned long long, MESSAGE_TYPE_COUNT> &counts)
+{
+    std::fprintf(out, "\"%s\": {", name);
+    for (int i = 0; i < MESSAGE_TYPE_COUNT; ++i)
+    {
+        std::fprintf(out, "%s\"%s\": %llu", i ? ", " : "", messageTypeName(static_cast<MessageType>(i)), counts[i]);
+    }
+    std::fprintf(out, "}");
+}
+
+static void writeHistogram(FILE *out, const char *name, const HistogramSnapshot &histogram)
+{
+    std::fprintf(out, "    \"%s\": {\"count\": %llu, \"mean_us\": %.1f, \"p50_us\": %llu, \"p90_us\": %llu, \"p99_us\": %llu, "
+                      "\"max_us\": %llu, \"buckets\": [",
+                 name, histogram.count, histogram.count ? static_cast<double>(histogram.sum_us) / histogram.count : 0.0,
+                 histogram.percentileUs(0.50), histogram.percentileUs(0.90), histogram.percentileUs(0.99), histogram.max_us);
+    bool first = true;
+    for (int i = 0; i < HistogramSnapshot::BUCKETS; ++i)
+    {
+        if (histogram.buckets[i] != 0)
+        {
+            std::fprintf(out, "%s{\"lt_us\": %llu, \"count\": %llu}", first ? "" : ", ", 1ULL << i, histogram.buckets[i]);
+            first = false;
+        }
+    }
+    std::fprintf(out, "]}");
+}
+
+static void writeCounters(FILE *out, const MetricsSnapshot &metrics)
+{
+    std::fprintf(out, "\"no_free_house_retries\": %llu, \"house_deferred_high_water\": %llu, "
+                      "\"paser_deferred_high_water\": %llu, \"peers_suspected\": %llu, \"request_timeouts\": %llu, ",
+                 metrics.no_free_house_retries, metrics.house_deferred_high_water, metrics.paser_deferred_high_water,
+                 metrics.peers_suspected, metrics.request_timeouts);
+    writeMessageCounts(out, "sent", metrics.sent);
+    std::fprintf(out, ", ");
+    writeMessageCounts(out, "received", metrics.received);
+}
+
+bool writeMetricsJson(const std::string &path, const std::vector<MetricsSnapshot> &per_rank)
+{
+    FILE *out = std::fopen(path.c_str(), "w");
+    if (!out)
+    {
+        return false;
+    }
+
+    MetricsSnapshot total;
+    for (const MetricsSnapshot &rank_metrics : per_rank)
+    {
+        total.merge(rank_metrics);
+    }
+
+    std::fprintf(out, "{\n  \"processes\": %zu,\n  \"total\": {", per_rank.size());
+    writeCounters(out, total);
+    std::fprintf(out, "},\n  \"histograms\": {\n");
+    writeHistogram(out, "want_house", total.want_house);
+    std::fprintf(out, ",\n");
+    writeHistogram(out, "want_paser", total.want_paser);
+    std::fprintf(out, ",\n");
+    writeHistogram(out, "house_reply_rtt", total.house_reply_rtt);
+    std::fprintf(out, ",\n");
+    writeHistogram(out, "paser_reply_rtt", total.paser_reply_rtt);
+    std::fprintf(out, ",\n");
+    writeHistogram(out, "queueing_delay", total.queueing_delay);
+    std::fprintf(out, "\n  },\n  \"ranks\": [\n");
+    for (size_t rank = 0; rank < per_rank.size(); ++rank)
+    {
+        std::fprintf(out, "    {\"rank\": %zu, ", rank);
+        writeCounters(out, per_rank[rank]);
+        std::fprintf(out, "}%s\n", rank + 1 < per_rank.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+    return std::fclose(out) == 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+// Plain copy of a LatencyHistogram; trivially copyable so ranks can ship it to rank 0 as bytes.
+struct HistogramSnapshot
+{
+    static const int BUCKETS = 40;
+    // Bucket 0 counts samples below 1 us, bucket i counts [2^(i-1), 2^i) us.
+    std::array<unsigned long long, BUCKETS> buckets{};
+    unsigned long long count = 0;
+    unsigned long long sum_us = 0;
+    unsigned long long max_us = 0;
+
+    void merge(const HistogramSnapshot &other);
+    // Upper bound of the bucket holding the p-quantile, clamped to the largest sample.
+    unsigned long long percentileUs(double p) const;
+};
+
+// Log2-bucketed latency histogram; record() is a handful of relaxed atomic adds.
+class LatencyHistogram
+{
+public:
+    void record(std::chrono::nanoseconds duration);
+    HistogramSnapshot snapshot() const;
+
+private:
+    std::array<std::atomic<unsigned long long>, HistogramSnapshot::BUCKETS> buckets{};
+    std::atomic<unsigned long long> count{0};
+    std::atomic<unsigned long long> sum_us{0};
+    std::atomic<unsigned long long> max_us{0};
+};
+
+struct MetricsSnapshot
+{
+    std::array<unsigned long long, MESSAGE_TYPE_COUNT> sent{};
+    std::array<unsigned long long, MESSAGE_TYPE_COUNT> received{};
+    unsigned long long no_free_house_retries = 0;
+    unsigned long long house_deferred_high_water = 0;
+    unsigned long long paser_deferred_high_water = 0;
+    unsigned long long peers_suspected = 0;  // failure detector suspicions, including ones later withdrawn
+    unsigned long long request_timeouts = 0; // requests that stopped waiting for at least one suspected peer
+    HistogramSnapshot want_house;      // time in WANT_HOUSE
+    HistogramSnapshot want_paser;      // time in HAVE_HOUSE_WANT_PASER
+    HistogramSnapshot house_reply_rtt; // house request to each reply (REPLY_HOUSE, MAEKAWA_LOCKED or TOKEN)
+    HistogramSnapshot paser_reply_rtt; // paser request to each REPLY_PASER
+    HistogramSnapshot queueing_delay;  // open-loop workloads: arrival of a job to the start of its cycle
+
+    // Counters and histograms add up; high-water marks take the maximum.
+    void merge(const MetricsSnapshot &other);
+};
+
+// Per-process instrumentation. Every recorder is a relaxed atomic so the listener, sender and main thread can
+// record without taking a lock; snapshot() is only meaningful once the process has stopped.
+class Metrics
+{
+public:
+    void countSent(MessageType type) { sent[static_cast<int>(type)].fetch_add(1, std::memory_order_relaxed); }
+    void countReceived(MessageType type) { received[static_cast<int>(type)].fetch_add(1, std::memory_order_relaxed); }
+    void countNoFreeHouse() { no_free_house_retries.fetch_add(1, std::memory_order_relaxed); }
+    void countPeerSuspected() { peers_suspected.fetch_add(1, std::memory_order_relaxed); }
+    void countRequestTimeout() { request_timeouts.fetch_add(1, std::memory_order_relaxed); }
+    void observeDeferredDepth(ResourceType type, size_t depth);
+
+    LatencyHistogram want_house;
+    LatencyHistogram want_paser;
+    LatencyHistogram house_reply_rtt;
+    LatencyHistogram paser_reply_rtt;
+    LatencyHistogram queueing_delay;
+
+    MetricsSnapshot snapshot() const;
+
+private:
+    std::array<std::atomic<unsigned long long>, MESSAGE_TYPE_COUNT> sent{};
+    std::array<std::atomic<unsigned long long>, MESSAGE_TYPE_COUNT> received{};
+    std::atomic<unsigned long long> no_free_house_retries{0};
+    std::atomic<unsigned long long> house_deferred_high_water{0};
+    std::atomic<unsigned long long> paser_deferred_high_water{0};
+    std::atomic<unsigned long long> peers_suspected{0};
+    std::atomic<unsigned long long> request_timeouts{0};
+};
+
+// Writes one JSON document: totals and histograms over every rank, then per-rank counters.
+bool writeMetricsJson(const std::string &path, const std::vector<MetricsSnapshot> &per_rank);
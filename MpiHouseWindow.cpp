@@ -0,0 +1,42 @@
+#include "MpiHouseWindow.h"
+
+MpiHouseWindow::MpiHouseWindow(int house_count) : count(house_count), window(MPI_WIN_NULL)
+{
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    int local_count = rank == HOST_RANK ? count : 0;
+    int *base = nullptr;
+    MPI_Win_allocate(static_cast<MPI_Aint>(local_count) * sizeof(int), sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD,
+                     &base, &window);
+    for (int i = 0; i < local_count; ++i)
+    {
+        base[i] = HOUSE_STATE_FREE;
+    }
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+    // Makes the initial table visible to RMA before any rank can reach it.
+    MPI_Win_sync(window);
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+MpiHouseWindow::~MpiHouseWindow()
+{
+    MPI_Win_unlock_all(window);
+    MPI_Win_free(&window);
+}
+
+void MpiHouseWindow::read(std::vector<int> &statuses)
+{
+    statuses.resize(count);
+    // A no-op accumulate, unlike MPI_Get, is atomic per element against concurrent compare-and-swaps.
+    MPI_Get_accumulate(nullptr, 0, MPI_INT, statuses.data(), count, MPI_INT, HOST_RANK, 0, count, MPI_INT, MPI_NO_OP,
+                       window);
+    MPI_Win_flush(HOST_RANK, window);
+}
+
+int MpiHouseWindow::compareAndSwap(int house_id, int expected, int desired)
+{
+    int found = HOUSE_STATE_FREE;
+    MPI_Compare_and_swap(&desired, &expected, &found, MPI_INT, HOST_RANK, house_id - 1, window);
+    MPI_Win_flush(HOST_RANK, window);
+    return found;
+}
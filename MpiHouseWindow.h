@@ -0,0 +1,26 @@
+#pragma once
+
+#include <mpi.h>
+#include <vector>
+
+#include "HouseWindow.h"
+
+// The house table lives in an RMA window on MPI rank 0 and is reached with passive-target atomics: a read is one
+// MPI_Get_accumulate(MPI_NO_OP) and a claim one MPI_Compare_and_swap, each completed by a flush. Every rank
+// holds a shared lock on the window for its whole life, so no operation waits for rank 0's protocol thread.
+// Construction and destruction are collective over MPI_COMM_WORLD; all logical processes of a rank share one.
+class MpiHouseWindow : public HouseWindow
+{
+public:
+    explicit MpiHouseWindow(int house_count);
+    ~MpiHouseWindow() override;
+
+    void read(std::vector<int> &statuses) override;
+    int compareAndSwap(int house_id, int expected, int desired) override;
+
+private:
+    static const int HOST_RANK = 0;
+
+    int count;
+    MPI_Win window;
+};
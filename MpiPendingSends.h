@@ -0,0 +1,89 @@
+#pragma once
+
+#include <mpi.h>
+#include <vector>
+
+// MPI_Isend's still in flight, each holding on to the buffer it sends from until its own request completes.
+// Nothing here waits on a particular peer: a slow receiver only keeps its own slots busy while new sends to
+// everyone else are posted into free ones. Owned and used by a single send thread.
+class MpiPendingSends
+{
+public:
+    MpiPendingSends() : in_flight(0) {}
+
+    void post(std::vector<int> &&words, int target, int tag, MPI_Comm comm)
+    {
+        int slot;
+        if (free_slots.empty())
+        {
+            slot = static_cast<int>(requests.size());
+            requests.push_back(MPI_REQUEST_NULL);
+            buffers.emplace_back();
+        }
+        else
+        {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+        buffers[slot] = std::move(words);
+        MPI_Isend(buffers[slot].data(), static_cast<int>(buffers[slot].size()), MPI_INT, target, tag, comm,
+                  &requests[slot]);
+        in_flight++;
+    }
+
+    // Frees the buffers of every send that has completed; true while some are still in flight.
+    bool reap()
+    {
+        if (in_flight == 0)
+        {
+            return false;
+        }
+        int completed_count = 0;
+        completed.resize(requests.size());
+        MPI_Testsome(static_cast<int>(requests.size()), requests.data(), &completed_count, completed.data(),
+                     MPI_STATUSES_IGNORE);
+        if (completed_count != MPI_UNDEFINED)
+        {
+            for (int i = 0; i < completed_count; ++i)
+            {
+                release(completed[i]);
+            }
+        }
+        return in_flight > 0;
+    }
+
+    void waitAll()
+    {
+        if (in_flight == 0)
+        {
+            return;
+        }
+        completed.clear();
+        for (size_t slot = 0; slot < requests.size(); ++slot)
+        {
+            if (requests[slot] != MPI_REQUEST_NULL)
+            {
+                completed.push_back(static_cast<int>(slot));
+            }
+        }
+        MPI_Waitall(static_cast<int>(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
+        for (int slot : completed)
+        {
+            release(slot);
+        }
+    }
+
+private:
+    std::vector<MPI_Request> requests; // MPI_REQUEST_NULL in free slots
+    std::vector<std::vector<int>> buffers;
+    std::vector<int> free_slots;
+    std::vector<int> completed;
+    int in_flight;
+
+    void release(int slot)
+    {
+        std::vector<int>().swap(buffers[slot]);
+        free_slots.push_back(slot);
+        in_flight--;
+    }
+};
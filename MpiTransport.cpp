@@ -0,0 +1,210 @@
+#include "MpiTransport.h"
+
+#include <algorithm>
+
+#include "TransportBundle.h"
+
+MpiTransport::MpiTransport(int ranks_per_node)
+    : max_batch_words(0), spans_nodes(false), recv_head(0), current_slot(-1), head_ready(false),
+      shutdown_request(MPI_REQUEST_NULL), bundle_request(MPI_REQUEST_NULL), current_is_own_part(false),
+      inter_node_messages(0), inter_node_batches(0), barrier_request(MPI_REQUEST_NULL)
+{
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+    int my_leader = 0;
+    if (ranks_per_node > 0)
+    {
+        my_leader = my_rank / ranks_per_node * ranks_per_node;
+    }
+    else
+    {
+        MPI_Comm node_comm;
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, &node_comm);
+        MPI_Allreduce(&my_rank, &my_leader, 1, MPI_INT, MPI_MIN, node_comm);
+        MPI_Comm_free(&node_comm);
+    }
+    node_leader.resize(world_size);
+    MPI_Allgather(&my_leader, 1, MPI_INT, node_leader.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    spans_nodes = std::any_of(node_leader.begin(), node_leader.end(), [my_leader](int leader)
+                              { return leader != my_leader; });
+    batches_by_leader.resize(world_size);
+}
+
+void MpiTransport::sendBatches(std::vector<TransportBatch> &batches)
+{
+    // Sends stay outstanding across flushes, so a slow peer never holds up batches to the others.
+    pending_sends.reap();
+    int my_leader = node_leader[my_rank];
+    leaders_in_order.clear();
+    for (size_t i = 0; i < batches.size(); ++i)
+    {
+        int leader = node_leader[batches[i].target_rank];
+        if (leader == my_leader)
+        {
+            pending_sends.post(std::move(batches[i].words), batches[i].target_rank, TAG_MESSAGE, MPI_COMM_WORLD);
+            continue;
+        }
+        if (batches_by_leader[leader].empty())
+        {
+            leaders_in_order.push_back(leader);
+        }
+        batches_by_leader[leader].push_back(i);
+    }
+
+    for (int leader : leaders_in_order)
+    {
+        bundles.clear();
+        TransportBundle::pack(batches, batches_by_leader[leader], 0, world_size, BUNDLE_WORDS_LIMIT, bundles);
+        for (std::vector<int> &bundle : bundles)
+        {
+            pending_sends.post(std::move(bundle), leader, TAG_BUNDLE, MPI_COMM_WORLD);
+        }
+        inter_node_messages += static_cast<long long>(bundles.size());
+        inter_node_batches += static_cast<long long>(batches_by_leader[leader].size());
+        batches_by_leader[leader].clear();
+    }
+}
+
+void MpiTransport::postReceive(int slot)
+{
+    MPI_Irecv(&recv_buffers[slot * max_batch_words], max_batch_words, MPI_INT, MPI_ANY_SOURCE, TAG_MESSAGE,
+              MPI_COMM_WORLD, &recv_requests[slot]);
+}
+
+void MpiTransport::startReceiving(int batch_words)
+{
+    max_batch_words = batch_words;
+    recv_buffers.assign(RECV_RING_SIZE * max_batch_words, 0);
+    recv_requests.assign(RECV_RING_SIZE, MPI_REQUEST_NULL);
+    for (int slot = 0; slot < RECV_RING_SIZE; ++slot)
+    {
+        postReceive(slot);
+    }
+    recv_head = 0;
+    head_ready = false;
+
+    MPI_Irecv(nullptr, 0, MPI_INT, my_rank, TAG_SHUTDOWN, MPI_COMM_WORLD, &shutdown_request);
+
+    // Only a leader of a multi-node run ever receives bundles. A bundle holds at most BUNDLE_WORDS_LIMIT words
+    // or a single part, which addresses at most every rank.
+    if (spans_nodes && node_leader[my_rank] == my_rank)
+    {
+        bundle_buffer.assign(std::max(BUNDLE_WORDS_LIMIT, static_cast<size_t>(3 + world_size + max_batch_words)), 0);
+        MPI_Irecv(bundle_buffer.data(), static_cast<int>(bundle_buffer.size()), MPI_INT, MPI_ANY_SOURCE, TAG_BUNDLE,
+                  MPI_COMM_WORLD, &bundle_request);
+    }
+}
+
+bool MpiTransport::waitForBatches()
+{
+    // Receives match in posting order, so the head slot is always the next message to arrive.
+    MPI_Request wait_set[3] = {recv_requests[recv_head], shutdown_request, bundle_request};
+    int index = MPI_UNDEFINED;
+    MPI_Waitany(3, wait_set, &index, MPI_STATUS_IGNORE);
+    recv_requests[recv_head] = wait_set[0];
+    shutdown_request = wait_set[1];
+    bundle_request = wait_set[2];
+
+    if (index == 2)
+    {
+        relayBundle();
+        return true;
+    }
+    head_ready = (index == 0);
+    return head_ready;
+}
+
+void MpiTransport::relayBundle()
+{
+    relay_sends.reap();
+    TransportBundle::unpack(bundle_buffer.data(), [this](int target, const int *words, int length)
+                            {
+        if (target == my_rank)
+        {
+            own_parts.emplace_back(words, words + length);
+        }
+        else
+        {
+            relay_sends.post(std::vector<int>(words, words + length), target, TAG_MESSAGE, MPI_COMM_WORLD);
+        } });
+    MPI_Irecv(bundle_buffer.data(), static_cast<int>(bundle_buffer.size()), MPI_INT, MPI_ANY_SOURCE, TAG_BUNDLE,
+              MPI_COMM_WORLD, &bundle_request);
+}
+
+const int *MpiTransport::nextBatch()
+{
+    if (!own_parts.empty())
+    {
+        current_is_own_part = true;
+        return own_parts.front().data();
+    }
+    current_is_own_part = false;
+    if (!head_ready)
+    {
+        int flag = 0;
+        MPI_Test(&recv_requests[recv_head], &flag, MPI_STATUS_IGNORE);
+        if (!flag)
+        {
+            return nullptr;
+        }
+    }
+    head_ready = false;
+    current_slot = recv_head;
+    recv_head = (recv_head + 1) % RECV_RING_SIZE;
+    return &recv_buffers[current_slot * max_batch_words];
+}
+
+void MpiTransport::releaseBatch()
+{
+    if (current_is_own_part)
+    {
+        own_parts.pop_front();
+        return;
+    }
+    postReceive(current_slot);
+}
+
+void MpiTransport::stopReceiving()
+{
+    for (MPI_Request &request : recv_requests)
+    {
+        if (request != MPI_REQUEST_NULL)
+        {
+            MPI_Cancel(&request);
+            MPI_Wait(&request, MPI_STATUS_IGNORE);
+        }
+    }
+    for (MPI_Request *request : {&shutdown_request, &bundle_request})
+    {
+        if (*request != MPI_REQUEST_NULL)
+        {
+            MPI_Cancel(request);
+            MPI_Wait(request, MPI_STATUS_IGNORE);
+        }
+    }
+    relay_sends.waitAll();
+}
+
+void MpiTransport::wakeReceiver()
+{
+    // Zero-length self message wakes the listener out of MPI_Waitany.
+    MPI_Send(nullptr, 0, MPI_INT, my_rank, TAG_SHUTDOWN, MPI_COMM_WORLD);
+}
+
+void MpiTransport::startBarrier()
+{
+    MPI_Ibarrier(MPI_COMM_WORLD, &barrier_request);
+}
+
+bool MpiTransport::testBarrier()
+{
+    int flag = 0;
+    MPI_Test(&barrier_request, &flag, MPI_STATUS_IGNORE);
+    return flag != 0;
+}
+
+void MpiTransport::waitBarrier()
+{
+    MPI_Wait(&barrier_request, MPI_STATUS_IGNORE);
+}
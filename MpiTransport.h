@@ -0,0 +1,86 @@
+#pragma once
+
+#include <deque>
+#include <mpi.h>
+#include <vector>
+
+#include "MpiPendingSends.h"
+#include "Transport.h"
+
+// One rank per MPI process on MPI_COMM_WORLD. Ranks are grouped into nodes, by default those that share memory
+// (MPI_COMM_TYPE_SHARED), and the lowest rank of each node is its leader. Batches to a rank on the same node go
+// straight to it. Batches to another node always travel as TransportBundles to that node's leader, at most one
+// per flush and node, and the leader's listener relays them to their targets; always taking that route keeps
+// per-target FIFO order. A broadcast thus crosses the network once per node instead of once per rank.
+class MpiTransport : public Transport
+{
+public:
+    // ranks_per_node > 0 groups every that many consecutive ranks as one node instead of asking MPI.
+    explicit MpiTransport(int ranks_per_node = 0);
+
+    int rank() const override { return my_rank; }
+    int size() const override { return world_size; }
+
+    void sendBatches(std::vector<TransportBatch> &batches) override;
+    bool reapSends() override { return pending_sends.reap(); }
+    void waitSends() override { pending_sends.waitAll(); }
+
+    // Traffic to other nodes: MPI messages sent to their leaders and the batches they carried. Read these once
+    // the send thread has stopped.
+    long long interNodeMessagesSent() const { return inter_node_messages; }
+    long long interNodeBatchesSent() const { return inter_node_batches; }
+
+    void startReceiving(int max_batch_words) override;
+    bool waitForBatches() override;
+    const int *nextBatch() override;
+    void releaseBatch() override;
+    void stopReceiving() override;
+    void wakeReceiver() override;
+
+    void startBarrier() override;
+    bool testBarrier() override;
+    void waitBarrier() override;
+
+private:
+    static const int RECV_RING_SIZE = 32;
+    static const int TAG_MESSAGE = 0;
+    static const int TAG_SHUTDOWN = 1;
+    static const int TAG_BUNDLE = 2;
+    // A bundle is closed before it would grow past this; the receive buffer also fits one maximal part.
+    static constexpr size_t BUNDLE_WORDS_LIMIT = 1 << 15;
+
+    int my_rank;
+    int world_size;
+    int max_batch_words;
+    std::vector<int> node_leader; // by rank
+    bool spans_nodes;
+
+    // Receive ring: RECV_RING_SIZE pre-posted MPI_Irecv's consumed in posting order.
+    std::vector<int> recv_buffers;
+    std::vector<MPI_Request> recv_requests;
+    int recv_head;
+    int current_slot;
+    bool head_ready;
+    MPI_Request shutdown_request;
+
+    // Leader side, listener thread only: one pre-posted bundle receive, the relays still in flight, and this
+    // rank's own parts of received bundles, handed out by nextBatch() before the ring.
+    std::vector<int> bundle_buffer;
+    MPI_Request bundle_request;
+    MpiPendingSends relay_sends;
+    std::deque<std::vector<int>> own_parts;
+    bool current_is_own_part;
+
+    // Send thread only.
+    MpiPendingSends pending_sends;
+    std::vector<std::vector<size_t>> batches_by_leader; // indices into the flush, by leader rank
+    std::vector<int> leaders_in_order;
+    std::vector<std::vector<int>> bundles;
+    long long inter_node_messages;
+    long long inter_node_batches;
+
+    MPI_Request barrier_request;
+
+    void postReceive(int slot);
+    void relayBundle();
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Dense set of process ids 1..N backed by a bitset with a cached member count.
+class PeerSet
+{
+public:
+    PeerSet() : remaining(0) {}
+
+    // Fills the set with every id in 1..n_ids except exclude_id; O(N/64).
+    void reset(int n_ids, int exclude_id)
+    {
+        size_t n_words = (static_cast<size_t>(n_ids) + 64) / 64;
+        words.assign(n_words, ~std::uint64_t(0));
+        words[0] &= ~std::uint64_t(1); // id 0 is never a process
+        int tail_bits = (n_ids + 1) % 64;
+        if (tail_bits != 0)
+        {
+            words.back() &= (std::uint64_t(1) << tail_bits) - 1;
+        }
+        if (exclude_id > 0 && exclude_id <= n_ids)
+        {
+            words[exclude_id / 64] &= ~(std::uint64_t(1) << (exclude_id % 64));
+        }
+
+        remaining = 0;
+        for (std::uint64_t word : words)
+        {
+            remaining += __builtin_popcountll(word);
+        }
+    }
+
+    void clear()
+    {
+        words.assign(words.size(), 0);
+        remaining = 0;
+    }
+
+    bool contains(int id) const
+    {
+        size_t word = static_cast<size_t>(id) / 64;
+        return id >= 0 && word < words.size() && (words[word] >> (id % 64)) & 1;
+    }
+
+    void insert(int id)
+    {
+        if (id < 0)
+        {
+            return;
+        }
+        size_t word = static_cast<size_t>(id) / 64;
+        if (word >= words.size())
+        {
+            words.resize(word + 1, 0);
+        }
+        std::uint64_t mask = std::uint64_t(1) << (id % 64);
+        if (!(words[word] & mask))
+        {
+            words[word] |= mask;
+            ++remaining;
+        }
+    }
+
+    void erase(int id)
+    {
+        if (contains(id))
+        {
+            words[id / 64] &= ~(std::uint64_t(1) << (id % 64));
+            --remaining;
+        }
+    }
+
+    // Removes every member of other; O(N/64).
+    void subtract(const PeerSet &other)
+    {
+        remaining = 0;
+        for (size_t word = 0; word < words.size(); ++word)
+        {
+            if (word < other.words.size())
+            {
+                words[word] &= ~other.words[word];
+            }
+            remaining += __builtin_popcountll(words[word]);
+        }
+    }
+
+    int size() const { return remaining; }
+    bool empty() const { return remaining == 0; }
+
+private:
+    std::vector<std::uint64_t> words;
+    int remaining;
+};
@@ -1,118 +1,332 @@
 #include "ProcessLogic.h"
 
-ProcessLogic::ProcessLogic(int id, int rank, int n_procs, int d_houses, int p_pasers)
-    : my_id(id), my_rank(rank),
-      N_PROCESSES_CONST(n_procs), D_HOUSES_CONST(d_houses), P_PASERS_CONST(p_pasers),
-      clock_manager(),
-      message_handler(id, rank, n_procs, clock_manager),
-      resource_manager(id, n_procs, d_houses, p_pasers, clock_manager, message_handler),
-      current_state(ProcessState::IDLE), terminate_flag(false)
+ProcessLogic::ProcessLogic(int id, const SimConfig &config, Transport &transport, HouseWindow *house_window)
+    : my_id(id), my_rank(transport.rank()),
+      N_PROCESSES_CONST(config.n_processes), D_HOUSES_CONST(config.d_houses), P_PASERS_CONST(config.p_pasers),
+      PREFER_LAST_HOUSE(config.prefer_last_house),
+      WORK_MIN_MS(config.work_min_ms), THINK_MEAN_MS(config.think_mean_ms),
+      TIME_SCALE(config.time_scale), TARGET_CYCLES(config.target_cycles), RUN_SECONDS(config.run_seconds),
+      clock_manager(config.clock_mode),
+      message_handler(id, config, clock_manager, transport, metrics),
+      resource_manager(id, config, clock_manager, message_handler, metrics, house_window),
+      current_state(ProcessState::IDLE), terminate_flag(false), workload_exhausted(false),
+      cycle_in_progress(false), termination_barrier_started(false), externally_clocked(false)
 {
-    rng.seed(my_id + std::chrono::system_clock::now().time_since_epoch().count());
-    log("ProcessLogic initialized.");
+    if (config.seed != 0)
+    {
+        std::seed_seq seq{static_cast<unsigned long long>(config.seed), static_cast<unsigned long long>(my_id)};
+        rng.seed(seq);
+    }
+    else
+    {
+        rng.seed(my_id + std::chrono::system_clock::now().time_since_epoch().count());
+    }
+    std::string workload_error;
+    workload = makeWorkload(config, my_id, rng, workload_error);
+    if (!workload)
+    {
+        log(LogLevel::ERROR, "No workload: ", workload_error);
+    }
+    log(LogLevel::INFO, "ProcessLogic initialized.");
 }
 
-void ProcessLogic::log(const std::string &message_content)
+void ProcessLogic::start(TimePoint now)
 {
-    std::cout << "[Logic P" << my_id << " C" << clock_manager.getTime() << " S:" << static_cast<int>(current_state) << "] " << message_content << std::endl;
+    message_handler.recordTime(ReplayRecord::START, now);
+    start_time = now;
+    state_entered_time = now;
+    end_time = start_time + std::chrono::seconds(RUN_SECONDS);
+    if (workload)
+    {
+        workload->start(now);
+    }
+    scheduleNextCycle(now);
 }
 
-void ProcessLogic::run()
+// Runs the state machine until it cannot progress at `now`; returns when it next has to run without new input.
+TimePoint ProcessLogic::advance(TimePoint now)
 {
-    //log("Process " + std::to_string(my_id) + " starting run loop.");
-    auto start_time = std::chrono::steady_clock::now();
-
-    listener_thread_obj = std::thread([this]()
-                                      { this->message_handler.listenForMessages(this); });
+    message_handler.recordTime(ReplayRecord::ADVANCE, now);
+    std::vector<int> suspected_peers;
+    TimePoint heartbeat_deadline = message_handler.pollFailureDetector(now, suspected_peers);
+    for (int peer_id : suspected_peers)
+    {
+        resource_manager.handlePeerSuspected(peer_id);
+    }
 
     while (!terminate_flag.load())
     {
-        { // Scope for lock_guard
-            std::lock_guard<std::mutex> lock(resource_manager.getMutex());
+        ProcessState previous_state = current_state;
+        bool progressed = false;
 
-            switch (current_state)
+        switch (current_state)
+        {
+        case ProcessState::IDLE:
+            if (shouldStartCycle(now))
             {
-            case ProcessState::IDLE:
-                if (shouldStartCycle())
-                {
-                    log("IDLE: ShouldStartCycle is true. Transitioning to WANT_HOUSE.");
-                    current_state = ProcessState::WANT_HOUSE;
-                    resource_manager.requestHouse();
-                }
-                break;
-
-            case ProcessState::WANT_HOUSE:
-                if (resource_manager.isRequestingHouse() && resource_manager.allHouseRepliesReceived())
+                log(LogLevel::INFO, "IDLE: ShouldStartCycle is true. Transitioning to WANT_HOUSE.");
+                if (!cycle_in_progress)
                 {
-                    log("WANT_HOUSE: All replies received. Entering CS for House.");
-                    enterHouseCriticalSection();
+                    cycle_in_progress = true;
+                    cycle_start_time = now;
+                    if (workload->isOpenLoop())
+                    {
+                        // Open-loop latency counts from the arrival, so it includes the wait behind earlier jobs.
+                        cycle_start_time = next_job.arrival;
+                        metrics.queueing_delay.record(now - next_job.arrival);
+                    }
                 }
-                break;
-
-            case ProcessState::HAVE_HOUSE_WANT_PASER:
-                if (!resource_manager.isRequestingPaser())
+                current_state = ProcessState::WANT_HOUSE;
+                house_request_time = now;
+                resource_manager.requestHouse(now);
+            }
+            else if (targetCyclesReached())
+            {
+                // Keep answering peers until every rank has finished its cycles.
+                if (!termination_barrier_started)
                 {
-                    log("HAVE_HOUSE_WANT_PASER: Requesting paser.");
-                    resource_manager.requestPaser();
+                    log(LogLevel::INFO, "Target of ", TARGET_CYCLES, " cycles reached. Waiting for the other ranks.");
+                    message_handler.flush();
+                    message_handler.startTerminationBarrier();
+                    termination_barrier_started = true;
                 }
-                else if (resource_manager.sufficientPaserRepliesReceived())
+                else if (message_handler.terminationBarrierDone())
                 {
-                    log("HAVE_HOUSE_WANT_PASER: All replies received. Entering CS for Paser.");
-                    enterPaserCriticalSection();
+                    stop();
                 }
-                break;
+            }
+            break;
 
-            case ProcessState::HAVE_BOTH:
-                log("HAVE_BOTH: (This state is usually brief, work simulation leads to RELEASING)");
-                break;
+        case ProcessState::WANT_HOUSE:
+            if (resource_manager.isRequestingHouse() &&
+                (resource_manager.allHouseRepliesReceived() || resource_manager.houseRequestFailed()))
+            {
+                log(LogLevel::DEBUG, "WANT_HOUSE: House request settled. Entering CS for House.");
+                enterHouseCriticalSection();
+            }
+            break;
 
-            case ProcessState::RELEASING:
-                if (resource_manager.isHouseHeld())
-                {
-                    log("RELEASING: House is held. Proceeding to release it.");
-                    releaseAcquiredHouse();
-                }
-                else if (resource_manager.isPaserHeld())
-                {
-                    log("RELEASING: Paser is held. Proceeding to release it.");
-                    releaseAcquiredPaser();
-                }
-                else
-                {
-                    log("RELEASING: No resources held. Transitioning to IDLE.");
-                    current_state = ProcessState::IDLE;
-                }
-                break;
+        case ProcessState::HAVE_HOUSE_WANT_PASER:
+            if (!resource_manager.isRequestingPaser())
+            {
+                log(LogLevel::DEBUG, "HAVE_HOUSE_WANT_PASER: Requesting paser.");
+                paser_request_time = now;
+                resource_manager.requestPaser();
+                progressed = true;
+            }
+            else if (resource_manager.isPaserGranted())
+            {
+                log(LogLevel::DEBUG, "HAVE_HOUSE_WANT_PASER: Paser slot granted. Entering CS for Paser.");
+                enterPaserCriticalSection(now);
+            }
+            break;
+
+        case ProcessState::HAVE_BOTH:
+            if (now >= work_end_time)
+            {
+                log(LogLevel::INFO, "Work simulation complete. Transitioning to RELEASING.");
+                current_state = ProcessState::RELEASING;
             }
+            break;
 
-            if (std::chrono::steady_clock::now() - start_time > std::chrono::seconds(600))
+        case ProcessState::RELEASING:
+            if (resource_manager.isHouseHeld())
             {
-                log("Run loop timeout. Signaling termination.");
-                stop();
+                log(LogLevel::DEBUG, "RELEASING: House is held. Proceeding to release it.");
+                releaseAcquiredHouse();
+                progressed = true;
             }
+            else if (resource_manager.isPaserHeld())
+            {
+                log(LogLevel::DEBUG, "RELEASING: Paser is held. Proceeding to release it.");
+                releaseAcquiredPaser();
+            }
+            else
+            {
+                log(LogLevel::INFO, "RELEASING: No resources held. Transitioning to IDLE.");
+                current_state = ProcessState::IDLE;
+            }
+            break;
+        }
+
+        if (now >= end_time)
+        {
+            log(LogLevel::WARN, "Run loop timeout. Signaling termination.");
+            stop();
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        if (current_state != previous_state)
+        {
+            if (Tracer::enabled())
+            {
+                Tracer::instance().recordState(my_id, previous_state, state_entered_time, now, clock_manager.getTime());
+            }
+            if (previous_state == ProcessState::WANT_HOUSE)
+            {
+                metrics.want_house.record(now - state_entered_time);
+            }
+            else if (previous_state == ProcessState::HAVE_HOUSE_WANT_PASER)
+            {
+                metrics.want_paser.record(now - state_entered_time);
+            }
+            state_entered_time = now;
+            if (current_state == ProcessState::IDLE)
+            {
+                scheduleNextCycle(now);
+            }
+            progressed = true;
+        }
+
+        if (!progressed)
+        {
+            break;
+        }
+    }
+
+    if (terminate_flag.load())
+    {
+        return TimePoint::max();
+    }
+    return std::min(heartbeat_deadline, nextDeadline(now));
+}
+
+TimePoint ProcessLogic::nextDeadline(TimePoint now) const
+{
+    if (termination_barrier_started)
+    {
+        return now + std::chrono::milliseconds(5);
+    }
+    if (current_state == ProcessState::IDLE && !targetCyclesReached())
+    {
+        return std::min(next_cycle_time, end_time);
+    }
+    if (current_state == ProcessState::HAVE_BOTH)
+    {
+        return std::min(work_end_time, end_time);
+    }
+    return end_time;
+}
+
+void ProcessLogic::run()
+{
+    //log(LogLevel::DEBUG, "Process ", my_id, " starting run loop.");
+    start(std::chrono::steady_clock::now());
+
+    listener_thread_obj = std::thread([this]()
+                                      { this->message_handler.listenForMessages(this); });
+    sender_thread_obj = std::thread([this]()
+                                    { this->message_handler.runSendLoop(); });
+
+    while (!terminate_flag.load())
+    {
+        applyInbound();
+        TimePoint deadline = advance(std::chrono::steady_clock::now());
+        if (terminate_flag.load())
+        {
+            break;
+        }
+        // End of a protocol step: hand everything produced since the last wait to the send thread.
+        message_handler.flush();
+        inbound.waitUntil(deadline);
+    }
+    //log(LogLevel::DEBUG, "Main run loop in ProcessLogic finished for process ", my_id, ". Waiting for listener thread...");
+
+    // Every rank passes the barrier before anyone tears down its listener, so no peer is left waiting on a reply.
+    if (!termination_barrier_started)
+    {
+        message_handler.flush();
+        message_handler.startTerminationBarrier();
+        termination_barrier_started = true;
+    }
+    message_handler.waitTerminationBarrier();
+    TimePoint finished_at = std::chrono::steady_clock::now();
+
+    // Flush everything still queued before the listener goes away.
+    message_handler.stopSending();
+    if (sender_thread_obj.joinable())
+    {
+        sender_thread_obj.join();
     }
-    //log("Main run loop in ProcessLogic finished for process " + std::to_string(my_id) + ". Waiting for listener thread...");
 
     message_handler.stopListening();
     if (listener_thread_obj.joinable())
     {
         listener_thread_obj.join();
     }
-    log("Listener thread joined.");
+    log(LogLevel::INFO, "Sender and listener threads joined.");
+    finish(finished_at);
+}
+
+TimePoint ProcessLogic::currentTime() const
+{
+    return externally_clocked ? external_now : std::chrono::steady_clock::now();
+}
+
+TimePoint ProcessLogic::step(TimePoint now)
+{
+    externally_clocked = true;
+    external_now = now;
+    Tracer::setThreadTime(now);
+    clock_manager.setPhysicalTime(now);
+    TimePoint deadline = advance(now);
+    message_handler.sendPendingNow();
+    return deadline;
+}
+
+void ProcessLogic::deliverBatch(const int *batch, TimePoint now)
+{
+    externally_clocked = true;
+    external_now = now;
+    Tracer::setThreadTime(now);
+    clock_manager.setPhysicalTime(now);
+    message_handler.dispatchBatch(batch, this);
+}
+
+void ProcessLogic::finish(TimePoint now)
+{
+    if (Tracer::enabled())
+    {
+        Tracer::instance().recordState(my_id, current_state, state_entered_time, now, clock_manager.getTime());
+    }
+    stats.elapsed_seconds = std::chrono::duration<double>(now - start_time).count();
+    stats.messages_sent = message_handler.getMessagesSent();
+    stats.batches_sent = message_handler.getBatchesSent();
+    log(LogLevel::INFO, "Run summary: ", stats.cs_entries, " CS entries, ", stats.messages_sent, " messages sent in ", stats.batches_sent, " batches.");
+    message_handler.stopRecording();
+}
+
+bool ProcessLogic::startRecording(const std::string &path, const SimConfig &config)
+{
+    return message_handler.startRecording(path, config);
 }
 
 void ProcessLogic::stop()
 {
-    log("Stop called. Setting terminate_flag.");
+    log(LogLevel::INFO, "Stop called. Setting terminate_flag.");
     terminate_flag = true;
+    inbound.wake();
+}
+
+void ProcessLogic::enqueueMessages(std::vector<Message> &&messages)
+{
+    inbound.push(std::move(messages));
+}
+
+void ProcessLogic::applyInbound()
+{
+    InboundQueue::Node *node = inbound.takeAll();
+    while (node)
+    {
+        message_handler.applyMessages(node->messages, this);
+        InboundQueue::Node *next = node->next;
+        delete node;
+        node = next;
+    }
 }
 
 void ProcessLogic::processIncomingMessage(const Message &msg)
 {
-    std::lock_guard<std::mutex> lock(resource_manager.getMutex());
-    log("Processing incoming msg type " + std::to_string(static_cast<int>(msg.type)) + " from " + std::to_string(msg.sender_id));
+    log(LogLevel::DEBUG, "Processing incoming msg type ", static_cast<int>(msg.type), " from ", msg.sender_id);
 
     switch (msg.type)
     {
@@ -120,81 +334,136 @@ void ProcessLogic::processIncomingMessage(const Message &msg)
         resource_manager.handleHouseRequest(msg);
         break;
     case MessageType::REPLY_HOUSE:
-        resource_manager.handleHouseReply(msg);
+    case MessageType::HOUSE_BUSY:
+        if (resource_manager.isRequestingHouse())
+        {
+            metrics.house_reply_rtt.record(currentTime() - house_request_time);
+        }
+        if (msg.type == MessageType::HOUSE_BUSY)
+        {
+            resource_manager.handleHouseBusy(msg);
+        }
+        else
+        {
+            resource_manager.handleHouseReply(msg);
+        }
         break;
     case MessageType::REQUEST_PASER:
         resource_manager.handlePaserRequest(msg);
         break;
     case MessageType::REPLY_PASER:
+        if (resource_manager.isRequestingPaser())
+        {
+            metrics.paser_reply_rtt.record(currentTime() - paser_request_time);
+        }
         resource_manager.handlePaserReply(msg);
         break;
+    case MessageType::RELEASE_PASER:
+        resource_manager.handlePaserRelease(msg);
+        break;
+    case MessageType::HEARTBEAT:
+        // Its arrival has already been noted by the failure detector.
+        break;
     case MessageType::UPDATE_HOUSE_STATE:
         resource_manager.updateLocalHouseState(msg.house_id, msg.new_house_status);
         break;
+    case MessageType::MAEKAWA_REQUEST:
+    case MessageType::MAEKAWA_LOCKED:
+    case MessageType::MAEKAWA_FAILED:
+    case MessageType::MAEKAWA_INQUIRE:
+    case MessageType::MAEKAWA_RELINQUISH:
+    case MessageType::MAEKAWA_RELEASE:
+    case MessageType::TOKEN_REQUEST:
+    case MessageType::TOKEN:
+        if ((msg.type == MessageType::MAEKAWA_LOCKED || msg.type == MessageType::TOKEN) && resource_manager.isRequestingHouse())
+        {
+            metrics.house_reply_rtt.record(currentTime() - house_request_time);
+        }
+        resource_manager.handleHouseLockMessage(msg);
+        break;
     }
-    log("Finished processing incoming msg type " + std::to_string(static_cast<int>(msg.type)));
+    log(LogLevel::DEBUG, "Finished processing incoming msg type ", static_cast<int>(msg.type));
 }
 
-bool ProcessLogic::shouldStartCycle()
+bool ProcessLogic::shouldStartCycle(TimePoint now)
 {
-    if (current_state == ProcessState::IDLE)
-    {
-        std::uniform_int_distribution<int> dist(1, 100);
-        return dist(rng) <= 25;
-    }
-    return false;
+    return current_state == ProcessState::IDLE && !targetCyclesReached() && now >= next_cycle_time;
 }
 
-void ProcessLogic::simulateWork()
+bool ProcessLogic::targetCyclesReached() const
 {
-    log("Simulating work with house and paser...");
+    return (TARGET_CYCLES > 0 && stats.cs_entries >= TARGET_CYCLES) || workload_exhausted;
+}
 
-    resource_manager.getMutex().unlock();
-    std::uniform_int_distribution<int> dist(4000, 5000); // milliseconds
-    std::this_thread::sleep_for(std::chrono::milliseconds(dist(rng)));
-    resource_manager.getMutex().lock(); // TODO rozważyć zmianę na unique_lock, bo to może nie być do końca poprawne
+void ProcessLogic::scheduleNextCycle(TimePoint now)
+{
+    if (cycle_in_progress)
+    {
+        // No free house last time: back off and retry the same job. Open-loop think_ms is the arrival gap, so
+        // those workloads wait about the shortest work time instead, by when a house held now may be free.
+        double backoff_ms = workload->isOpenLoop() ? std::max(WORK_MIN_MS, 1) : THINK_MEAN_MS;
+        std::exponential_distribution<double> dist(1.0 / (backoff_ms * TIME_SCALE)); // milliseconds
+        next_cycle_time = now + std::chrono::microseconds(static_cast<long long>(dist(rng) * 1000.0));
+        return;
+    }
+    if (!workload || !workload->next(now, next_job))
+    {
+        if (!workload_exhausted)
+        {
+            log(LogLevel::INFO, "Workload exhausted; no further cycles.");
+        }
+        workload_exhausted = true;
+        return;
+    }
+    next_cycle_time = next_job.arrival;
+}
 
-    log("Work simulation complete. Transitioning to RELEASING.");
-    current_state = ProcessState::RELEASING;
+void ProcessLogic::startWork(TimePoint now)
+{
+    work_end_time = now + next_job.work;
+    log(LogLevel::DEBUG, "Simulating work with house and paser...");
 }
 
 void ProcessLogic::enterHouseCriticalSection()
 {
-    log("Attempting to enter House CS.");
-    bool acquired_house = false;
+    log(LogLevel::DEBUG, "Attempting to enter House CS.");
     int chosen_house_id = 0;
 
-    if (D_HOUSES_CONST > 0)
+    if (resource_manager.usesPerHouseLocks())
     {
-        auto house_states = resource_manager.getHouseStates();
-        for (int k = 1; k <= D_HOUSES_CONST; ++k)
-        {
-            if (house_states.count(k) == 0 || house_states.at(k) == HOUSE_STATE_FREE)
-            {
-                chosen_house_id = k;
-                acquired_house = true;
-                break;
-            }
-        }
+        // The lock was taken on this one house; 0 means every free house turned out to be busy.
+        chosen_house_id = resource_manager.getTargetHouseId();
+    }
+    else if (resource_manager.usesHouseWindow())
+    {
+        chosen_house_id = resource_manager.claimHouse(PREFER_LAST_HOUSE ? resource_manager.getLastHeldHouseId() : 0);
+    }
+    else if (D_HOUSES_CONST > 0)
+    {
+        int preferred_house_id = PREFER_LAST_HOUSE ? resource_manager.getLastHeldHouseId() : 0;
+        chosen_house_id = resource_manager.getHouseTable().findFree(preferred_house_id);
     }
+    bool acquired_house = chosen_house_id != 0;
 
     if (acquired_house)
     {
         resource_manager.recordHouseAcquired(chosen_house_id);
-        log("Acquired house " + std::to_string(chosen_house_id) + ". Transitioning to HAVE_HOUSE_WANT_PASER.");
+        log(LogLevel::INFO, "Acquired house ", chosen_house_id, ". Transitioning to HAVE_HOUSE_WANT_PASER.");
         current_state = ProcessState::HAVE_HOUSE_WANT_PASER;
     }
     else
     {
-        log("No free house found. Returning to IDLE.");
+        log(LogLevel::WARN, "No free house found. Returning to IDLE.");
+        stats.no_free_house_retries++;
+        metrics.countNoFreeHouse();
         current_state = ProcessState::IDLE;
-        resource_manager.processDeferredQueues(ResourceType::HOUSE_RESOURCE);
+        resource_manager.releaseHouseLock();
     }
 }
 
-void ProcessLogic::enterPaserCriticalSection()
+void ProcessLogic::enterPaserCriticalSection(TimePoint now)
 {
-    log("Attempting to enter Paser CS.");
+    log(LogLevel::DEBUG, "Attempting to enter Paser CS.");
 
     bool acquired_paser = false;
     if (P_PASERS_CONST > 0)
@@ -205,40 +474,43 @@ void ProcessLogic::enterPaserCriticalSection()
     if (acquired_paser)
     {
         resource_manager.recordPaserAcquired();
-        log("Acquired a paser. Transitioning to HAVE_BOTH.");
+        log(LogLevel::INFO, "Acquired a paser. Transitioning to HAVE_BOTH.");
+        stats.cs_entries++;
+        stats.entry_latencies_us.push_back(std::chrono::duration<double, std::micro>(now - cycle_start_time).count());
+        cycle_in_progress = false;
         current_state = ProcessState::HAVE_BOTH;
-        simulateWork();
+        startWork(now);
     }
     else
     {
-        log("Could not acquire a paser (P=" + std::to_string(P_PASERS_CONST) + "). Releasing house and returning to IDLE.");
+        log(LogLevel::WARN, "Could not acquire a paser (P=", P_PASERS_CONST, "). Releasing house and returning to IDLE.");
         current_state = ProcessState::RELEASING;
-        resource_manager.processDeferredQueues(ResourceType::PASER_RESOURCE);
+        resource_manager.releasePaser();
     }
 }
 
 void ProcessLogic::releaseAcquiredHouse()
 {
-    log("Releasing acquired house.");
+    log(LogLevel::INFO, "Releasing acquired house.");
     resource_manager.recordHouseReleased();
-    resource_manager.processDeferredQueues(ResourceType::HOUSE_RESOURCE);
+    resource_manager.releaseHouseLock();
 
     if (!resource_manager.isPaserHeld())
     {
-        log("House released, no paser held. Transitioning to IDLE.");
+        log(LogLevel::INFO, "House released, no paser held. Transitioning to IDLE.");
         current_state = ProcessState::IDLE;
     }
     else
     {
-        log("House released. Paser still held. State remains RELEASING (for paser).");
+        log(LogLevel::DEBUG, "House released. Paser still held. State remains RELEASING (for paser).");
     }
 }
 
 void ProcessLogic::releaseAcquiredPaser()
 {
-    log("Releasing acquired paser.");
+    log(LogLevel::INFO, "Releasing acquired paser.");
     resource_manager.recordPaserReleased();
-    resource_manager.processDeferredQueues(ResourceType::PASER_RESOURCE);
-    log("Paser released. Transitioning to IDLE.");
+    resource_manager.releasePaser();
+    log(LogLevel::INFO, "Paser released. Transitioning to IDLE.");
     current_state = ProcessState::IDLE;
 }
\ No newline at end of file
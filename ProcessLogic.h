@@ -6,45 +6,125 @@
 #include <thread>
 #include <iostream>
 #include <atomic>
+#include <vector>
 
 #include "types.h"
+#include "Logger.h"
 #include "ClockManager.h"
+#include "Transport.h"
+#include "Metrics.h"
+#include "Tracer.h"
 #include "MessageHandler.h"
 #include "ResourceManager.h"
+#include "InboundQueue.h"
+#include "Workload.h"
+
+using TimePoint = std::chrono::steady_clock::time_point;
+
+struct RunStats
+{
+    long long cs_entries = 0; // entries into HAVE_BOTH
+    long long no_free_house_retries = 0;
+    long long messages_sent = 0;
+    long long batches_sent = 0; // transport-level messages after coalescing
+    double elapsed_seconds = 0.0;
+    std::vector<double> entry_latencies_us; // first WANT_HOUSE of a cycle -> HAVE_BOTH
+};
 
 class ProcessLogic
 {
 public:
-    ProcessLogic(int id, int rank, int n_procs, int d_houses, int p_pasers);
+    // house_window is required by MutexAlgorithm::HOUSE_WINDOW and ignored otherwise; it must outlive the process.
+    ProcessLogic(int id, const SimConfig &config, Transport &transport, HouseWindow *house_window = nullptr);
     void run();
     void stop();
+    // Called by the listener; the messages are applied on the protocol thread at its next wakeup.
+    void enqueueMessages(std::vector<Message> &&messages);
     void processIncomingMessage(const Message &msg);
 
+    // Driving the process without its own threads, e.g. from the discrete-event simulator: start() once,
+    // then step() whenever time passes or a batch was delivered. step() sends what the protocol produced on
+    // the calling thread and returns the next time it needs to be stepped without any input.
+    void start(TimePoint now);
+    TimePoint step(TimePoint now);
+    void deliverBatch(const int *batch, TimePoint now);
+    void finish(TimePoint now);
+    // Writes a replay log (see ReplayLog.h) from start() to finish(); call before start() or run().
+    bool startRecording(const std::string &path, const SimConfig &config);
+    bool isFinished() const { return terminate_flag.load(); }
+    const RunStats &getStats() const { return stats; }
+    // For drivers that check mutual exclusion across processes: the house held (0 if none) and the paser flag.
+    int heldHouseId() const { return resource_manager.getHeldHouseId(); }
+    bool holdsPaser() const { return resource_manager.isPaserHeld(); }
+    MetricsSnapshot getMetrics() const { return metrics.snapshot(); }
+
 private:
     int my_id;
     int my_rank;
     const int N_PROCESSES_CONST;
     const int D_HOUSES_CONST;
     const int P_PASERS_CONST;
+    const bool PREFER_LAST_HOUSE;
+    const int WORK_MIN_MS;
+    const double THINK_MEAN_MS;
+    const double TIME_SCALE;
+    const int TARGET_CYCLES;
+    const int RUN_SECONDS;
 
     ClockManager clock_manager;
+    Metrics metrics;
     MessageHandler message_handler;
     ResourceManager resource_manager;
 
     ProcessState current_state;
     std::atomic<bool> terminate_flag;
     std::mt19937 rng;
+    std::unique_ptr<Workload> workload; // null if the trace could not be read: the process then runs no cycles
+    WorkloadJob next_job;               // the job whose cycle starts at next_cycle_time
+    bool workload_exhausted;
     std::thread listener_thread_obj;
+    std::thread sender_thread_obj;
+
+    // run() keeps all protocol state on one thread; the listener only decodes batches into this queue.
+    InboundQueue inbound;
+    TimePoint start_time;
+    TimePoint end_time;
+    TimePoint next_cycle_time;
+    TimePoint cycle_start_time;
+    TimePoint work_end_time;
+    TimePoint state_entered_time;
+    TimePoint house_request_time;
+    TimePoint paser_request_time;
+    bool cycle_in_progress;
+    bool termination_barrier_started;
+    // Set once step() drives the process; message handling then uses the driver's time instead of the wall clock.
+    bool externally_clocked;
+    TimePoint external_now;
+    RunStats stats;
 
-    void log(const std::string &message_content);
-    bool shouldStartCycle();
-    void simulateWork();
+    template <typename... Args>
+    void log(LogLevel level, const Args &...args) const
+    {
+        if (Logger::enabled(level))
+        {
+            Logger::instance().write(level, "[Logic P", my_id, " C", clock_manager.getTime(), " S:", current_state, "] ", args...);
+        }
+    }
+    TimePoint advance(TimePoint now);
+    TimePoint nextDeadline(TimePoint now) const;
+    void applyInbound();
+    TimePoint currentTime() const;
+    bool shouldStartCycle(TimePoint now);
+    // TARGET_CYCLES entries made, or the workload has no jobs left.
+    bool targetCyclesReached() const;
+    void scheduleNextCycle(TimePoint now);
+    void startWork(TimePoint now);
 
     void tryAcquireHouse();
     void tryAcquirePaser();
     void initiateReleaseSequence();
     void enterHouseCriticalSection();
-    void enterPaserCriticalSection();
+    void enterPaserCriticalSection(TimePoint now);
     void releaseAcquiredHouse();
     void releaseAcquiredPaser();
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "ReplayDriver.h"
+
+ReplayDriver::ReplayDriver(ReplayLogContents &&contents)
+    : log(std::move(contents)), message_count(0), step_count(0), last_step_record(0), valid(true)
+{
+    // Every record is checked here once, so replayOnce() can trust the lengths it reads.
+    const std::vector<int> &words = log.words;
+    size_t cursor = log.first_record;
+    while (cursor < words.size())
+    {
+        size_t remaining = words.size() - cursor;
+        ReplayRecord kind = static_cast<ReplayRecord>(words[cursor]);
+        if (kind == ReplayRecord::MESSAGE)
+        {
+            if (remaining < 2 || words[cursor + 1] < 0 || remaining - 2 < static_cast<size_t>(words[cursor + 1]) ||
+                !MessageHandler::batchFits(&words[cursor + 2], static_cast<size_t>(words[cursor + 1])))
+            {
+                valid = false;
+                return;
+            }
+            message_count++;
+            cursor += 2 + words[cursor + 1];
+            continue;
+        }
+        if ((kind != ReplayRecord::START && kind != ReplayRecord::ADVANCE) || remaining < 1 + TIMESTAMP_WORDS)
+        {
+            valid = false;
+            return;
+        }
+        if (kind == ReplayRecord::ADVANCE)
+        {
+            step_count++;
+            last_step_record = cursor;
+        }
+        cursor += 1 + TIMESTAMP_WORDS;
+    }
+}
+
+RunStats ReplayDriver::replayOnce()
+{
+    ReplayTransport transport(log.process_id - 1, log.config.n_processes);
+    SharedHouseWindow house_window(log.config.d_houses);
+    ProcessLogic logic(log.process_id, log.config, transport, &house_window);
+    const std::vector<int> &words = log.words;
+    TimePoint now;
+
+    size_t cursor = log.first_record;
+    while (cursor < words.size() && !logic.isFinished())
+    {
+        ReplayRecord kind = static_cast<ReplayRecord>(words[cursor]);
+        if (kind == ReplayRecord::MESSAGE)
+        {
+            logic.deliverBatch(&words[cursor + 2], now);
+            cursor += 2 + words[cursor + 1];
+            continue;
+        }
+
+        std::chrono::nanoseconds since_epoch(readTimestamp(&words[cursor + 1]));
+        now = TimePoint(std::chrono::duration_cast<TimePoint::duration>(since_epoch));
+        if (kind == ReplayRecord::START)
+        {
+            logic.start(now);
+        }
+        else
+        {
+            if (cursor == last_step_record)
+            {
+                transport.openBarrier();
+            }
+            logic.step(now);
+        }
+        cursor += 1 + TIMESTAMP_WORDS;
+    }
+    logic.finish(now);
+    return logic.getStats();
+}
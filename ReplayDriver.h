@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "Transport.h"
+#include "ProcessLogic.h"
+#include "ReplayLog.h"
+
+// Transport for replays: whatever the process sends is encoded and batched as usual, then dropped.
+class ReplayTransport : public Transport
+{
+public:
+    ReplayTransport(int rank, int size) : my_rank(rank), world_size(size), barrier_open(false) {}
+
+    int rank() const override { return my_rank; }
+    int size() const override { return world_size; }
+
+    void sendBatches(std::vector<TransportBatch> &) override {}
+
+    // The driver delivers recorded batches itself, so there is nothing to receive from.
+    void startReceiving(int) override {}
+    bool waitForBatches() override { return false; }
+    const int *nextBatch() override { return nullptr; }
+    void releaseBatch() override {}
+    void stopReceiving() override {}
+    void wakeReceiver() override {}
+
+    // The recorded run left the termination barrier on its last step; the driver opens it right before that one.
+    void startBarrier() override {}
+    bool testBarrier() override { return barrier_open; }
+    void waitBarrier() override {}
+    void openBarrier() { barrier_open = true; }
+
+private:
+    int my_rank;
+    int world_size;
+    bool barrier_open;
+};
+
+// Feeds a replay log back through a fresh ProcessLogic on the calling thread: recorded messages go through
+// deliverBatch() and recorded steps through step(), with no network, threads or sleeps. Given the same seed
+// and inputs the state machine takes the same decisions, so a pass measures only the protocol's CPU cost.
+class ReplayDriver
+{
+public:
+    explicit ReplayDriver(ReplayLogContents &&log);
+
+    // False if a record runs past the end of the log, as the last one of a killed run does.
+    bool isValid() const { return valid; }
+    const SimConfig &config() const { return log.config; }
+    int processId() const { return log.process_id; }
+    long long messagesPerPass() const { return message_count; }
+    long long stepsPerPass() const { return step_count; }
+
+    // One complete pass over the log; returns the replayed process's stats.
+    RunStats replayOnce();
+
+private:
+    ReplayLogContents log;
+    long long message_count;
+    long long step_count;
+    size_t last_step_record; // the step on which the recorded run passed its termination barrier
+    bool valid;
+};
@@ -0,0 +1,174 @@
+#include "ReplayLog.h"
+
+#include <cstring>
+
+namespace
+{
+    const int REPLAY_MAGIC = 0x505a5231; // "PZR1"
+    const int REPLAY_VERSION = 3;
+    const size_t HEADER_WORDS = 30; // fixed part; the trace path follows
+
+    void appendDouble(std::vector<int> &words, double value)
+    {
+        Timestamp bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        appendTimestamp(words, bits);
+    }
+
+    double readDouble(const int *words)
+    {
+        Timestamp bits = readTimestamp(words);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+}
+
+ReplayRecorder::ReplayRecorder(const std::string &path, int process_id, const SimConfig &config)
+    : file(std::fopen(path.c_str(), "wb"))
+{
+    buffer.reserve(BUFFER_WORDS);
+    buffer.push_back(REPLAY_MAGIC);
+    buffer.push_back(REPLAY_VERSION);
+    buffer.push_back(process_id);
+    buffer.push_back(config.n_processes);
+    buffer.push_back(config.d_houses);
+    buffer.push_back(config.p_pasers);
+    buffer.push_back(config.prefer_last_house);
+    buffer.push_back(static_cast<int>(config.house_algorithm));
+    buffer.push_back(static_cast<int>(config.house_locks));
+    buffer.push_back(config.piggyback_house_state);
+    buffer.push_back(static_cast<int>(config.clock_mode));
+    buffer.push_back(config.heartbeat_ms);
+    buffer.push_back(config.work_min_ms);
+    buffer.push_back(config.work_max_ms);
+    appendDouble(buffer, config.think_mean_ms);
+    appendDouble(buffer, config.time_scale);
+    buffer.push_back(config.target_cycles);
+    buffer.push_back(config.run_seconds);
+    appendTimestamp(buffer, static_cast<Timestamp>(config.seed));
+    buffer.push_back(static_cast<int>(config.workload));
+    appendDouble(buffer, config.work_pareto_alpha);
+    appendDouble(buffer, config.burst_factor);
+    appendDouble(buffer, config.burst_period_ms);
+    // Path length in bytes, then the bytes packed into words.
+    buffer.push_back(static_cast<int>(config.trace_path.size()));
+    size_t path_words = (config.trace_path.size() + sizeof(int) - 1) / sizeof(int);
+    buffer.resize(buffer.size() + path_words, 0);
+    std::memcpy(buffer.data() + buffer.size() - path_words, config.trace_path.data(), config.trace_path.size());
+}
+
+ReplayRecorder::~ReplayRecorder()
+{
+    flush();
+    if (file)
+    {
+        std::fclose(file);
+    }
+}
+
+void ReplayRecorder::reserve(size_t words)
+{
+    if (buffer.size() + words > BUFFER_WORDS)
+    {
+        flush();
+    }
+}
+
+void ReplayRecorder::recordTime(ReplayRecord kind, std::chrono::steady_clock::time_point now)
+{
+    reserve(1 + TIMESTAMP_WORDS);
+    buffer.push_back(static_cast<int>(kind));
+    appendTimestamp(buffer, std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
+}
+
+std::vector<int> &ReplayRecorder::beginMessage(int batch_words)
+{
+    size_t record_words = 2 + static_cast<size_t>(batch_words);
+    std::vector<int> &target = record_words > BUFFER_WORDS ? oversized : buffer;
+    if (&target == &oversized)
+    {
+        // Everything recorded so far goes out first so the file keeps its order.
+        flush();
+    }
+    else
+    {
+        reserve(record_words);
+    }
+    target.push_back(static_cast<int>(ReplayRecord::MESSAGE));
+    target.push_back(batch_words);
+    return target;
+}
+
+void ReplayRecorder::endMessage()
+{
+    if (!oversized.empty())
+    {
+        if (file)
+        {
+            std::fwrite(oversized.data(), sizeof(int), oversized.size(), file);
+        }
+        oversized.clear();
+    }
+}
+
+void ReplayRecorder::flush()
+{
+    if (file && !buffer.empty())
+    {
+        std::fwrite(buffer.data(), sizeof(int), buffer.size(), file);
+    }
+    buffer.clear();
+}
+
+bool readReplayLog(const std::string &path, ReplayLogContents &contents)
+{
+    FILE *in = std::fopen(path.c_str(), "rb");
+    if (!in)
+    {
+        return false;
+    }
+    std::fseek(in, 0, SEEK_END);
+    long bytes = std::ftell(in);
+    std::fseek(in, 0, SEEK_SET);
+    contents.words.resize(bytes > 0 ? static_cast<size_t>(bytes) / sizeof(int) : 0);
+    size_t read = std::fread(contents.words.data(), sizeof(int), contents.words.size(), in);
+    std::fclose(in);
+
+    const std::vector<int> &words = contents.words;
+    if (read != words.size() || words.size() < HEADER_WORDS || words[0] != REPLAY_MAGIC || words[1] != REPLAY_VERSION)
+    {
+        return false;
+    }
+    SimConfig &config = contents.config;
+    contents.process_id = words[2];
+    config.n_processes = words[3];
+    config.d_houses = words[4];
+    config.p_pasers = words[5];
+    config.prefer_last_house = words[6] != 0;
+    config.house_algorithm = static_cast<MutexAlgorithm>(words[7]);
+    config.house_locks = static_cast<HouseLockScope>(words[8]);
+    config.piggyback_house_state = words[9] != 0;
+    config.clock_mode = static_cast<ClockMode>(words[10]);
+    config.heartbeat_ms = words[11];
+    config.work_min_ms = words[12];
+    config.work_max_ms = words[13];
+    config.think_mean_ms = readDouble(&words[14]);
+    config.time_scale = readDouble(&words[16]);
+    config.target_cycles = words[18];
+    config.run_seconds = words[19];
+    config.seed = static_cast<unsigned long long>(readTimestamp(&words[20]));
+    config.workload = static_cast<WorkloadKind>(words[22]);
+    config.work_pareto_alpha = readDouble(&words[23]);
+    config.burst_factor = readDouble(&words[25]);
+    config.burst_period_ms = readDouble(&words[27]);
+    size_t path_bytes = static_cast<size_t>(words[29]);
+    size_t path_words = (path_bytes + sizeof(int) - 1) / sizeof(int);
+    if (words.size() < HEADER_WORDS + path_words)
+    {
+        return false;
+    }
+    config.trace_path.assign(reinterpret_cast<const char *>(&words[HEADER_WORDS]), path_bytes);
+    contents.first_record = HEADER_WORDS + path_words;
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+// Binary log of everything that drives one ProcessLogic, so its handlers can be re-run offline by ReplayDriver.
+// The file is a stream of 32-bit words: a header with the process id and the SimConfig it was built with, then
+// one record per start, per advance of the state machine and per applied message. A message record carries a
+// one-message batch in MessageHandler's wire layout, so a replay decodes it exactly like a received batch.
+// Times (steady-clock nanoseconds) and other 64-bit values take two words, in the same form as a Timestamp.
+enum class ReplayRecord
+{
+    START,   // time
+    ADVANCE, // time
+    MESSAGE  // batch length, batch words
+};
+
+class ReplayRecorder
+{
+public:
+    ReplayRecorder(const std::string &path, int process_id, const SimConfig &config);
+    ~ReplayRecorder();
+
+    bool isOpen() const { return file != nullptr; }
+
+    void recordTime(ReplayRecord kind, std::chrono::steady_clock::time_point now);
+    // Starts a MESSAGE record; the caller appends exactly batch_words words to the returned buffer, then calls
+    // endMessage().
+    std::vector<int> &beginMessage(int batch_words);
+    void endMessage();
+    void flush();
+
+private:
+    // Records accumulate here and reach the file in one write whenever the buffer fills up.
+    static const size_t BUFFER_WORDS = 1 << 16;
+
+    std::FILE *file;
+    std::vector<int> buffer;
+    // A record larger than the whole buffer is built here and written on its own, so buffer never grows.
+    std::vector<int> oversized;
+
+    void reserve(size_t words);
+};
+
+struct ReplayLogContents
+{
+    int process_id = 0;
+    SimConfig config;
+    std::vector<int> words;
+    size_t first_record = 0; // index of the first word after the header
+};
+
+// Reads a whole log into memory; false if the file is missing, truncated or not a replay log.
+bool readReplayLog(const std::string &path, ReplayLogContents &contents);
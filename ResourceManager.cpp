@@ -1,82 +1,223 @@
 #include "ResourceManager.h"
 
-ResourceManager::ResourceManager(int process_id, int n_procs, int d_houses, int p_pasers,
-                                 ClockManager &clock_mgr, MessageHandler &msg_handler)
-    : my_id(process_id), N_PROCESSES_CONST(n_procs), D_HOUSES_CONST(d_houses), P_PASERS_CONST(p_pasers),
-      clock_manager(clock_mgr), message_handler(msg_handler),
-      held_house_id_val(0), requesting_house(false), house_request_timestamp(0),
-      holding_paser_flag(false), requesting_paser(false), paser_request_timestamp(0)
+ResourceManager::ResourceManager(int process_id, const SimConfig &config,
+                                 ClockManager &clock_mgr, MessageHandler &msg_handler, Metrics &metrics_ref,
+                                 HouseWindow *window)
+    : my_id(process_id), N_PROCESSES_CONST(config.n_processes), D_HOUSES_CONST(config.d_houses), P_PASERS_CONST(config.p_pasers),
+      clock_manager(clock_mgr), message_handler(msg_handler), metrics(metrics_ref),
+      house_algorithm(config.house_algorithm),
+      piggyback_house_state(config.piggyback_house_state && config.house_algorithm == MutexAlgorithm::RICART_AGRAWALA),
+      per_house_locks(config.house_locks == HouseLockScope::PER_HOUSE && config.house_algorithm == MutexAlgorithm::RICART_AGRAWALA),
+      prefer_last_house(config.prefer_last_house),
+      stale_table_probe_interval(std::chrono::microseconds(static_cast<long long>(config.work_min_ms * config.time_scale * 1000.0))),
+      last_table_refresh(std::chrono::steady_clock::time_point::min()), table_news(false), house_window(window),
+      house_table(config.d_houses), held_house_id_val(0), last_held_house_id(0), requesting_house(false), house_request_timestamp(0),
+      target_house_id(0), houses_tried(house_table.emptyMask()), holding_paser_flag(false), requesting_paser(false), paser_request_timestamp(0)
 {
-    for (int i = 1; i <= D_HOUSES_CONST; ++i)
+    if (house_algorithm == MutexAlgorithm::MAEKAWA)
     {
-        local_house_state[i] = HOUSE_STATE_FREE;
+        maekawa_mutex = std::make_unique<MaekawaMutex>(process_id, config.n_processes, clock_mgr, msg_handler);
     }
-    log("ResourceManager initialized.");
-}
-
-void ResourceManager::log(const std::string &message_content) const
-{
-    std::cout << "[ResMgr P" << my_id << " C" << clock_manager.getTime() << "] " << message_content << std::endl;
+    else if (house_algorithm == MutexAlgorithm::SUZUKI_KASAMI)
+    {
+        token_mutex = std::make_unique<SuzukiKasamiMutex>(process_id, config.n_processes, clock_mgr, msg_handler);
+    }
+    if (config.piggyback_house_state && !piggyback_house_state)
+    {
+        log(LogLevel::WARN, "House state piggybacking needs Ricart-Agrawala; keeping UPDATE_HOUSE_STATE broadcasts.");
+    }
+    if (usesHouseWindow() && !house_window)
+    {
+        log(LogLevel::ERROR, "The window house algorithm was selected without a house window; no house can be claimed.");
+    }
+    log(LogLevel::INFO, "ResourceManager initialized.");
 }
 
 #pragma region house
-void ResourceManager::requestHouse()
+void ResourceManager::requestHouse(std::chrono::steady_clock::time_point now)
 {
-    log("Initiating RequestHouse.");
+    log(LogLevel::DEBUG, "Initiating RequestHouse.");
     requesting_house = true;
+    house_attempt_time = now;
+    if (table_news)
+    {
+        last_table_refresh = now;
+        table_news = false;
+    }
     house_request_timestamp = clock_manager.getTime();
 
-    house_replies_needed.clear();
-    for (int i = 1; i <= N_PROCESSES_CONST; ++i)
+    if (house_algorithm == MutexAlgorithm::MAEKAWA)
     {
-        if (i != my_id)
-        {
-            house_replies_needed.insert(i);
-        }
+        maekawa_mutex->request(house_request_timestamp);
+        return;
+    }
+    if (house_algorithm == MutexAlgorithm::SUZUKI_KASAMI)
+    {
+        token_mutex->request();
+        return;
+    }
+    if (usesHouseWindow())
+    {
+        // Nothing to ask anyone: the claim itself is the lock.
+        return;
+    }
+
+    if (per_house_locks)
+    {
+        std::fill(houses_tried.begin(), houses_tried.end(), 0);
+        target_house_id = 0;
+        requestTargetHouse();
+        return;
     }
-    log("Broadcasting REQUEST_HOUSE with ts " + std::to_string(house_request_timestamp) + ". Expecting " + std::to_string(house_replies_needed.size()) + " replies.");
+
+    resetRepliesNeeded(house_replies_needed);
+    log(LogLevel::DEBUG, "Broadcasting REQUEST_HOUSE with ts ", house_request_timestamp, ". Expecting ", house_replies_needed.size(), " replies.");
     message_handler.broadcastMessage(MessageType::REQUEST_HOUSE, house_request_timestamp);
 }
 
+// Picks the next free house not yet tried in this attempt and asks every peer for it. Requesters start at
+// different houses so that an idle pool is not contended on its lowest id. Every target gets a fresh timestamp:
+// Ricart-Agrawala is only safe if a request is newer than every request its sender has already answered.
+void ResourceManager::requestTargetHouse()
+{
+    // Requests deferred for the house we are moving away from are no longer ours to hold up.
+    sendDeferredHouseReplies();
+    int start_id = prefer_last_house && last_held_house_id != 0 ? last_held_house_id
+                                                                 : (my_id - 1) % std::max(D_HOUSES_CONST, 1) + 1;
+    target_house_id = D_HOUSES_CONST > 0 ? house_table.findFreeFrom(start_id, houses_tried) : 0;
+    if (target_house_id == 0 && D_HOUSES_CONST > 0 && piggyback_house_state &&
+        house_attempt_time >= last_table_refresh + stale_table_probe_interval &&
+        std::all_of(houses_tried.begin(), houses_tried.end(), [](std::uint64_t word)
+                    { return word == 0; }))
+    {
+        // Without UPDATE_HOUSE_STATE broadcasts a full table may just be stale; the answers to one request
+        // bring back every peer's versions.
+        target_house_id = start_id;
+    }
+    if (target_house_id == 0)
+    {
+        log(LogLevel::DEBUG, "No untried free house left for this attempt.");
+        return;
+    }
+    HouseTable::addToMask(houses_tried, target_house_id);
+    // Every answer carries the peer's house versions.
+    last_table_refresh = house_attempt_time;
+    house_request_timestamp = clock_manager.getTime();
+    resetRepliesNeeded(house_replies_needed);
+    log(LogLevel::DEBUG, "Broadcasting REQUEST_HOUSE for house ", target_house_id, " with ts ", house_request_timestamp);
+    message_handler.broadcastMessage(MessageType::REQUEST_HOUSE, house_request_timestamp, target_house_id);
+}
+
 void ResourceManager::handleHouseRequest(const Message &msg)
 {
-    log("Handling HOUSE request from " + std::to_string(msg.sender_id) + " (ts:" + std::to_string(msg.timestamp) + ")");
-    std::pair<int, int> my_priority = getMyPriority(ResourceType::HOUSE_RESOURCE);
-    std::pair<int, int> sender_priority = {msg.timestamp, msg.sender_id};
+    log(LogLevel::DEBUG, "Handling HOUSE request from ", msg.sender_id, " (ts:", msg.timestamp, ", house:", msg.house_id, ")");
+    if (per_house_locks)
+    {
+        bool holding_it = held_house_id_val != 0 && held_house_id_val == msg.house_id;
+        bool outranks_sender = requesting_house && target_house_id == msg.house_id &&
+                               std::make_pair(house_request_timestamp, my_id) < std::make_pair(msg.timestamp, msg.sender_id);
+        if (holding_it)
+        {
+            // The payload echoes the request; the status names us as the holder.
+            log(LogLevel::DEBUG, "House ", msg.house_id, " held; HOUSE_BUSY to ", msg.sender_id);
+            std::vector<int> payload;
+            appendTimestamp(payload, msg.timestamp);
+            if (piggyback_house_state)
+            {
+                house_table.appendVersionVector(payload);
+            }
+            message_handler.sendMessage(msg.sender_id - 1, MessageType::HOUSE_BUSY, clock_manager.getTime(), msg.house_id,
+                                        my_id, payload);
+        }
+        else if (outranks_sender)
+        {
+            log(LogLevel::DEBUG, "Deferring reply to ", msg.sender_id, " for house ", msg.house_id);
+            addToDeferredQueue(msg.sender_id, msg.timestamp);
+        }
+        else
+        {
+            sendReply(msg.sender_id, ResourceType::HOUSE_RESOURCE, msg.timestamp, msg.house_id);
+        }
+        return;
+    }
 
-    bool am_i_requesting_or_holding = requesting_house || (held_house_id_val != 0);
+    std::pair<Timestamp, int> my_priority = getMyPriority(ResourceType::HOUSE_RESOURCE);
+    std::pair<Timestamp, int> sender_priority = {msg.timestamp, msg.sender_id};
+
+    bool holding = held_house_id_val != 0;
     bool sender_has_higher_priority = (sender_priority.first < my_priority.first) ||
                                       (sender_priority.first == my_priority.first && sender_priority.second < my_priority.second);
 
-    if (!am_i_requesting_or_holding || sender_has_higher_priority)
+    // A holder always defers; getMyPriority() is only meaningful while a request is outstanding.
+    if (!holding && (!requesting_house || sender_has_higher_priority))
     {
-        log("Replying immediately to " + std::to_string(msg.sender_id) + " for HOUSE");
-        sendReply(msg.sender_id, ResourceType::HOUSE_RESOURCE);
+        log(LogLevel::DEBUG, "Replying immediately to ", msg.sender_id, " for HOUSE");
+        sendReply(msg.sender_id, ResourceType::HOUSE_RESOURCE, msg.timestamp);
     }
     else
     {
-        log("Deferring reply to " + std::to_string(msg.sender_id) + " for HOUSE");
-        addToDeferredQueue(msg.sender_id, ResourceType::HOUSE_RESOURCE);
+        log(LogLevel::DEBUG, "Deferring reply to ", msg.sender_id, " for HOUSE");
+        addToDeferredQueue(msg.sender_id, msg.timestamp);
     }
 }
 
 void ResourceManager::handleHouseReply(const Message &msg)
 {
-    log("Handling HOUSE reply from " + std::to_string(msg.sender_id) + " (ts:" + std::to_string(msg.timestamp) + ")");
-    if (!requesting_house || msg.timestamp < house_request_timestamp)
+    log(LogLevel::DEBUG, "Handling HOUSE reply from ", msg.sender_id, " (ts:", msg.timestamp, ")");
+    if (piggyback_house_state)
+    {
+        // Versioned entries are safe to merge even from a stale reply.
+        house_table.mergeVersionVector(msg.payload, TIMESTAMP_WORDS);
+    }
+    // A per-house reply must also name the house we are still after.
+    if (!requesting_house || !echoesHouseRequest(msg) ||
+        (per_house_locks && msg.house_id != target_house_id))
     {
-        log("Stale/unexpected HOUSE reply from " + std::to_string(msg.sender_id) + ". My req_ts: " + std::to_string(house_request_timestamp) + ", reply_ts: " + std::to_string(msg.timestamp));
+        log(LogLevel::WARN, "Stale/unexpected HOUSE reply from ", msg.sender_id, ". My req_ts: ", house_request_timestamp, ", reply_ts: ", msg.timestamp);
         return;
     }
     removeFromRepliesNeeded(msg.sender_id, ResourceType::HOUSE_RESOURCE);
 }
 
+// REPLY_HOUSE and HOUSE_BUSY open with the timestamp of the request they answer.
+bool ResourceManager::echoesHouseRequest(const Message &msg) const
+{
+    return msg.payload.size() >= static_cast<size_t>(TIMESTAMP_WORDS) &&
+           readTimestamp(msg.payload.data()) == house_request_timestamp;
+}
+
+void ResourceManager::handleHouseBusy(const Message &msg)
+{
+    if (!requesting_house || !echoesHouseRequest(msg) || msg.house_id != target_house_id)
+    {
+        log(LogLevel::DEBUG, "Ignoring HOUSE_BUSY from ", msg.sender_id, " for an abandoned request.");
+        return;
+    }
+    if (piggyback_house_state)
+    {
+        house_table.mergeVersionVector(msg.payload, TIMESTAMP_WORDS);
+    }
+    else if (msg.new_house_status != HOUSE_STATE_FREE)
+    {
+        updateLocalHouseState(msg.house_id, msg.new_house_status);
+    }
+    log(LogLevel::DEBUG, "House ", msg.house_id, " refused by ", msg.sender_id, "; trying another house.");
+    requestTargetHouse();
+}
+
 void ResourceManager::updateLocalHouseState(int house_id, int status)
 {
-    if (house_id > 0 && house_id <= D_HOUSES_CONST)
+    if (house_table.contains(house_id))
     {
-        local_house_state[house_id] = status;
-        log("Updated local_house_state[" + std::to_string(house_id) + "] to " + (status == HOUSE_STATE_FREE ? "FREE" : "TAKEN_BY_" + std::to_string(status)));
+        house_table.set(house_id, status);
+        if (status == HOUSE_STATE_FREE)
+        {
+            log(LogLevel::DEBUG, "Updated local_house_state[", house_id, "] to FREE");
+        }
+        else
+        {
+            log(LogLevel::DEBUG, "Updated local_house_state[", house_id, "] to TAKEN_BY_", status);
+        }
     }
 }
 
@@ -92,16 +233,68 @@ int ResourceManager::getHeldHouseId() const
 
 bool ResourceManager::allHouseRepliesReceived() const
 {
-    return house_replies_needed.empty();
+    switch (house_algorithm)
+    {
+    case MutexAlgorithm::MAEKAWA:
+        return maekawa_mutex->isGranted();
+    case MutexAlgorithm::SUZUKI_KASAMI:
+        return token_mutex->isGranted();
+    case MutexAlgorithm::HOUSE_WINDOW:
+        return true;
+    default:
+        return house_replies_needed.empty() && (!per_house_locks || target_house_id != 0);
+    }
+}
+
+void ResourceManager::releaseHouseLock()
+{
+    requesting_house = false;
+    switch (house_algorithm)
+    {
+    case MutexAlgorithm::MAEKAWA:
+        maekawa_mutex->release();
+        break;
+    case MutexAlgorithm::SUZUKI_KASAMI:
+        token_mutex->release();
+        break;
+    case MutexAlgorithm::HOUSE_WINDOW:
+        break;
+    default:
+        sendDeferredHouseReplies();
+        break;
+    }
+    target_house_id = 0;
+}
+
+void ResourceManager::handleHouseLockMessage(const Message &msg)
+{
+    if (msg.type == MessageType::TOKEN_REQUEST || msg.type == MessageType::TOKEN)
+    {
+        if (token_mutex)
+        {
+            token_mutex->handleMessage(msg);
+        }
+    }
+    else if (maekawa_mutex)
+    {
+        maekawa_mutex->handleMessage(msg);
+    }
+    else
+    {
+        log(LogLevel::WARN, "Ignoring house lock message of type ", static_cast<int>(msg.type), " from ", msg.sender_id, ".");
+    }
 }
 
 void ResourceManager::recordHouseAcquired(int house_id)
 {
     held_house_id_val = house_id;
-    local_house_state[house_id] = my_id;
+    house_table.record(house_id, my_id);
     requesting_house = false;
-    log("Recorded acquisition of house " + std::to_string(house_id));
-    message_handler.broadcastMessage(MessageType::UPDATE_HOUSE_STATE, -1, house_id, my_id);
+    log(LogLevel::INFO, "Recorded acquisition of house ", house_id);
+    if (!piggyback_house_state && !usesHouseWindow())
+    {
+        message_handler.broadcastMessage(MessageType::UPDATE_HOUSE_STATE, -1, house_id, my_id);
+    }
 }
 
 void ResourceManager::recordHouseReleased()
@@ -109,67 +302,121 @@ void ResourceManager::recordHouseReleased()
     if (held_house_id_val != 0)
     {
         int released_hid = held_house_id_val;
-        local_house_state[released_hid] = HOUSE_STATE_FREE;
+        house_table.record(released_hid, HOUSE_STATE_FREE);
         held_house_id_val = 0;
+        last_held_house_id = released_hid;
         requesting_house = false;
-        log("Recorded release of house " + std::to_string(released_hid));
-        message_handler.broadcastMessage(MessageType::UPDATE_HOUSE_STATE, -1, released_hid, HOUSE_STATE_FREE);
+        log(LogLevel::INFO, "Recorded release of house ", released_hid);
+        if (usesHouseWindow())
+        {
+            int found = house_window ? house_window->compareAndSwap(released_hid, my_id, HOUSE_STATE_FREE) : my_id;
+            if (found != my_id)
+            {
+                log(LogLevel::ERROR, "House ", released_hid, " was held by ", found, " in the window, not by this process.");
+            }
+        }
+        else if (!piggyback_house_state)
+        {
+            message_handler.broadcastMessage(MessageType::UPDATE_HOUSE_STATE, -1, released_hid, HOUSE_STATE_FREE);
+        }
     }
 }
-
-std::map<int, int> ResourceManager::getHouseStates() const
+// One read of the whole window, then a compare-and-swap per candidate until one sticks. A failed swap only means
+// another process claimed that house since the read, so the scan simply moves on.
+int ResourceManager::claimHouse(int preferred_house_id)
 {
-    return local_house_state;
+    if (!house_window || D_HOUSES_CONST <= 0)
+    {
+        return 0;
+    }
+    house_window->read(window_statuses);
+    int start_id = preferred_house_id != 0 ? preferred_house_id : (my_id - 1) % D_HOUSES_CONST + 1;
+    for (int offset = 0; offset < D_HOUSES_CONST; ++offset)
+    {
+        int house_id = (start_id - 1 + offset) % D_HOUSES_CONST + 1;
+        if (window_statuses[house_id - 1] != HOUSE_STATE_FREE)
+        {
+            continue;
+        }
+        int found = house_window->compareAndSwap(house_id, HOUSE_STATE_FREE, my_id);
+        if (found == HOUSE_STATE_FREE)
+        {
+            return house_id;
+        }
+        log(LogLevel::DEBUG, "House ", house_id, " was claimed by ", found, " after the window was read.");
+    }
+    return 0;
 }
 #pragma endregion house
 
 #pragma region paser
 void ResourceManager::requestPaser()
 {
-    log("Initiating RequestPaser.");
+    log(LogLevel::DEBUG, "Initiating RequestPaser.");
     requesting_paser = true;
     paser_request_timestamp = clock_manager.getTime();
 
-    paser_replies_needed.clear();
-    for (int i = 1; i <= N_PROCESSES_CONST; ++i)
+    resetRepliesNeeded(paser_replies_needed);
+    paser_queue.insert({paser_request_timestamp, my_id});
+    log(LogLevel::DEBUG, "Broadcasting REQUEST_PASER with ts ", paser_request_timestamp, ". Expecting ", paser_replies_needed.size(), " replies.");
+    message_handler.broadcastMessage(MessageType::REQUEST_PASER, paser_request_timestamp, 0, 0, ownHouseEntry());
+}
+
+void ResourceManager::releasePaser()
+{
+    paser_queue.erase({paser_request_timestamp, my_id});
+    requesting_paser = false;
+    log(LogLevel::DEBUG, "Broadcasting RELEASE_PASER for ts ", paser_request_timestamp);
+    message_handler.broadcastMessage(MessageType::RELEASE_PASER, paser_request_timestamp, 0, 0, ownHouseEntry());
+}
+
+// Piggybacking only. A paser request follows a house acquisition and a paser release follows the house release,
+// both as broadcasts, so they carry the change UPDATE_HOUSE_STATE would otherwise announce.
+std::vector<int> ResourceManager::ownHouseEntry() const
+{
+    std::vector<int> entry;
+    int house_id = held_house_id_val != 0 ? held_house_id_val : last_held_house_id;
+    if (piggyback_house_state && house_id != 0)
     {
-        if (i != my_id)
-        {
-            paser_replies_needed.insert(i);
-        }
+        house_table.appendEntry(entry, house_id);
     }
-    log("Broadcasting REQUEST_PASER with ts " + std::to_string(paser_request_timestamp) + ". Expecting " + std::to_string(paser_replies_needed.size()) + " replies.");
-    message_handler.broadcastMessage(MessageType::REQUEST_PASER, paser_request_timestamp);
+    return entry;
 }
 
 void ResourceManager::handlePaserRequest(const Message &msg)
 {
-    log("Handling PASER request from " + std::to_string(msg.sender_id) + " (ts:" + std::to_string(msg.timestamp) + ")");
-    std::pair<int, int> my_priority = getMyPriority(ResourceType::PASER_RESOURCE);
-    std::pair<int, int> sender_priority = {msg.timestamp, msg.sender_id};
-
-    bool am_i_requesting_or_holding = requesting_paser || holding_paser_flag;
-    bool sender_has_higher_priority = (sender_priority.first < my_priority.first) ||
-                                      (sender_priority.first == my_priority.first && sender_priority.second < my_priority.second);
-
-    if (!am_i_requesting_or_holding || sender_has_higher_priority)
+    // Never deferred: the reply only promises that every earlier request from us has already arrived.
+    log(LogLevel::DEBUG, "Queueing PASER request from ", msg.sender_id, " (ts:", msg.timestamp, ")");
+    if (piggyback_house_state && !msg.payload.empty())
     {
-        log("Replying immediately to " + std::to_string(msg.sender_id) + " for PASER");
-        sendReply(msg.sender_id, ResourceType::PASER_RESOURCE);
+        house_table.mergeVersionVector(msg.payload);
+        table_news = true;
     }
-    else
+    paser_queue.insert({msg.timestamp, msg.sender_id});
+    if (static_cast<int>(paser_queue.size()) > P_PASERS_CONST)
+    {
+        metrics.observeDeferredDepth(ResourceType::PASER_RESOURCE, paser_queue.size() - P_PASERS_CONST);
+    }
+    sendReply(msg.sender_id, ResourceType::PASER_RESOURCE);
+}
+
+void ResourceManager::handlePaserRelease(const Message &msg)
+{
+    log(LogLevel::DEBUG, "Handling PASER release from ", msg.sender_id, " (ts:", msg.timestamp, ")");
+    if (piggyback_house_state && !msg.payload.empty())
     {
-        log("Deferring reply to " + std::to_string(msg.sender_id) + " for PASER");
-        addToDeferredQueue(msg.sender_id, ResourceType::PASER_RESOURCE);
+        house_table.mergeVersionVector(msg.payload);
+        table_news = true;
     }
+    paser_queue.erase({msg.timestamp, msg.sender_id});
 }
 
 void ResourceManager::handlePaserReply(const Message &msg)
 {
-    log("Handling PASER reply from " + std::to_string(msg.sender_id) + " (ts:" + std::to_string(msg.timestamp) + ")");
+    log(LogLevel::DEBUG, "Handling PASER reply from ", msg.sender_id, " (ts:", msg.timestamp, ")");
     if (!requesting_paser || msg.timestamp < paser_request_timestamp)
     {
-        log("Stale/unexpected PASER reply from " + std::to_string(msg.sender_id) + ". My req_ts: " + std::to_string(paser_request_timestamp) + ", reply_ts: " + std::to_string(msg.timestamp));
+        log(LogLevel::WARN, "Stale/unexpected PASER reply from ", msg.sender_id, ". My req_ts: ", paser_request_timestamp, ", reply_ts: ", msg.timestamp);
         return;
     }
     removeFromRepliesNeeded(msg.sender_id, ResourceType::PASER_RESOURCE);
@@ -180,32 +427,49 @@ bool ResourceManager::isPaserHeld() const
     return holding_paser_flag;
 }
 
-bool ResourceManager::sufficientPaserRepliesReceived() const
+bool ResourceManager::isPaserGranted() const
 {
     if (P_PASERS_CONST <= 0)
     {
-        log("Error: P_PASERS_CONST is not positive, cannot acquire paser.");
+        log(LogLevel::ERROR, "Error: P_PASERS_CONST is not positive, cannot acquire paser.");
+        return false;
+    }
+    if (!requesting_paser || !paser_replies_needed.empty())
+    {
         return false;
     }
-    return paser_replies_needed.size() < P_PASERS_CONST;
+    // FIFO channels plus the acknowledgements mean every request older than ours is already queued here.
+    int rank = 0;
+    for (const std::pair<Timestamp, int> &request : paser_queue)
+    {
+        if (request.second == my_id)
+        {
+            return true;
+        }
+        if (++rank >= P_PASERS_CONST)
+        {
+            return false;
+        }
+    }
+    return false;
 }
 
 void ResourceManager::recordPaserAcquired()
 {
     holding_paser_flag = true;
     requesting_paser = false;
-    log("Recorded paser acquisition.");
+    log(LogLevel::INFO, "Recorded paser acquisition.");
 }
 
 void ResourceManager::recordPaserReleased()
 {
     holding_paser_flag = false;
     requesting_paser = false;
-    log("Recorded paser release.");
+    log(LogLevel::INFO, "Recorded paser release.");
 }
 #pragma endregion paser
 
-std::pair<int, int> ResourceManager::getMyPriority(ResourceType type)
+std::pair<Timestamp, int> ResourceManager::getMyPriority(ResourceType type)
 {
     if (type == ResourceType::HOUSE_RESOURCE && requesting_house)
     {
@@ -218,47 +482,86 @@ std::pair<int, int> ResourceManager::getMyPriority(ResourceType type)
     return {N_PROCESSES_CONST + D_HOUSES_CONST + P_PASERS_CONST + 10000, my_id};
 }
 
-void ResourceManager::processDeferredQueues(ResourceType type)
+void ResourceManager::sendDeferredHouseReplies()
 {
-    if (type == ResourceType::HOUSE_RESOURCE)
+    int house_id = per_house_locks ? target_house_id : 0;
+    while (!house_deferred_queue.empty())
     {
-        while (!house_deferred_queue.empty())
-        {
-            int p_id = house_deferred_queue.front();
-            house_deferred_queue.pop();
-            log("Sending deferred REPLY_HOUSE to " + std::to_string(p_id));
-            sendReply(p_id, ResourceType::HOUSE_RESOURCE);
-        }
+        std::pair<int, Timestamp> deferred = house_deferred_queue.front();
+        house_deferred_queue.pop();
+        log(LogLevel::DEBUG, "Sending deferred REPLY_HOUSE to ", deferred.first);
+        sendReply(deferred.first, ResourceType::HOUSE_RESOURCE, deferred.second, house_id);
     }
-    else
+}
+
+// REPLY_HOUSE payload: the timestamp of the request it answers, then the version vector when piggybacking.
+void ResourceManager::sendReply(int target_id, ResourceType resource_type, Timestamp request_ts, int house_id)
+{
+    MessageType reply_type = (resource_type == ResourceType::HOUSE_RESOURCE) ? MessageType::REPLY_HOUSE : MessageType::REPLY_PASER;
+    std::vector<int> payload;
+    if (resource_type == ResourceType::HOUSE_RESOURCE)
     {
-        while (!paser_deferred_queue.empty())
+        appendTimestamp(payload, request_ts);
+        if (piggyback_house_state)
         {
-            int p_id = paser_deferred_queue.front();
-            paser_deferred_queue.pop();
-            log("Sending deferred REPLY_PASER to " + std::to_string(p_id));
-            sendReply(p_id, ResourceType::PASER_RESOURCE);
+            house_table.appendVersionVector(payload);
         }
     }
+    message_handler.sendMessage(target_id - 1, reply_type, clock_manager.getTime(), house_id, 0, payload);
+    log(LogLevel::DEBUG, "Sent ", resource_type == ResourceType::HOUSE_RESOURCE ? "REPLY_HOUSE" : "REPLY_PASER", " to ", target_id);
 }
 
-void ResourceManager::sendReply(int target_id, ResourceType resource_type)
+// Peers currently suspected by the failure detector are not waited for.
+void ResourceManager::resetRepliesNeeded(PeerSet &replies_needed)
 {
-    MessageType reply_type = (resource_type == ResourceType::HOUSE_RESOURCE) ? MessageType::REPLY_HOUSE : MessageType::REPLY_PASER;
-    message_handler.sendMessage(target_id - 1, reply_type, clock_manager.getTime());
-    log("Sent " + std::string(resource_type == ResourceType::HOUSE_RESOURCE ? "REPLY_HOUSE" : "REPLY_PASER") + " to " + std::to_string(target_id));
+    replies_needed.reset(N_PROCESSES_CONST, my_id);
+    if (message_handler.failureDetectorEnabled())
+    {
+        replies_needed.subtract(message_handler.suspectedPeers());
+    }
 }
 
-void ResourceManager::addToDeferredQueue(int sender_id, ResourceType resource_type)
+void ResourceManager::handlePeerSuspected(int peer_id)
 {
-    if (resource_type == ResourceType::HOUSE_RESOURCE)
+    if (requesting_house && house_replies_needed.contains(peer_id))
     {
-        house_deferred_queue.push(sender_id);
+        log(LogLevel::WARN, "House request stops waiting for suspected peer ", peer_id);
+        house_replies_needed.erase(peer_id);
+        metrics.countRequestTimeout();
     }
-    else
+    if (requesting_paser && paser_replies_needed.contains(peer_id))
     {
-        paser_deferred_queue.push(sender_id);
+        log(LogLevel::WARN, "Paser request stops waiting for suspected peer ", peer_id);
+        paser_replies_needed.erase(peer_id);
+        metrics.countRequestTimeout();
     }
+
+    // Its queued paser requests would otherwise keep their slots forever.
+    for (auto it = paser_queue.begin(); it != paser_queue.end();)
+    {
+        it = it->second == peer_id ? paser_queue.erase(it) : std::next(it);
+    }
+
+    // Replies deferred to the peer stay queued and go out on release as usual: a peer that was only slow is
+    // still waiting for them, and a dead one just never reads them.
+    for (int house_id = 1; house_id <= D_HOUSES_CONST; ++house_id)
+    {
+        if (house_table.status(house_id) == peer_id)
+        {
+            updateLocalHouseState(house_id, HOUSE_STATE_FREE);
+        }
+        // Only the swap that still finds the peer's id frees the house, however many processes suspect it.
+        if (usesHouseWindow() && house_window)
+        {
+            house_window->compareAndSwap(house_id, peer_id, HOUSE_STATE_FREE);
+        }
+    }
+}
+
+void ResourceManager::addToDeferredQueue(int sender_id, Timestamp request_ts)
+{
+    house_deferred_queue.push({sender_id, request_ts});
+    metrics.observeDeferredDepth(ResourceType::HOUSE_RESOURCE, house_deferred_queue.size());
 }
 
 void ResourceManager::removeFromRepliesNeeded(int sender_id, ResourceType resource_type)
@@ -266,11 +569,11 @@ void ResourceManager::removeFromRepliesNeeded(int sender_id, ResourceType resour
     if (resource_type == ResourceType::HOUSE_RESOURCE)
     {
         house_replies_needed.erase(sender_id);
-        log("Removed " + std::to_string(sender_id) + " from house_replies_needed. Remaining: " + std::to_string(house_replies_needed.size()));
+        log(LogLevel::DEBUG, "Removed ", sender_id, " from house_replies_needed. Remaining: ", house_replies_needed.size());
     }
     else
     {
         paser_replies_needed.erase(sender_id);
-        log("Removed " + std::to_string(sender_id) + " from paser_replies_needed. Remaining: " + std::to_string(paser_replies_needed.size()));
+        log(LogLevel::DEBUG, "Removed ", sender_id, " from paser_replies_needed. Remaining: ", paser_replies_needed.size());
     }
 }
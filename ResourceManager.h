@@ -1,51 +1,75 @@
 #pragma once
 
-#include <set>
+#include <chrono>
+#include <cstdint>
 #include <queue>
+#include <set>
 #include <string>
-#include <mutex>
-#include <map>
 #include <iostream>
 #include <algorithm>
+#include <memory>
 
 #include "types.h"
+#include "Logger.h"
 #include "ClockManager.h"
+#include "PeerSet.h"
+#include "HouseTable.h"
+#include "HouseWindow.h"
+#include "MaekawaMutex.h"
+#include "SuzukiKasamiMutex.h"
 #include "MessageHandler.h"
+#include "Metrics.h"
 
 class ResourceManager
 {
 public:
-    ResourceManager(int process_id, int n_procs, int d_houses, int p_pasers, ClockManager &clock_mgr, MessageHandler &msg_handler);
+    ResourceManager(int process_id, const SimConfig &config, ClockManager &clock_mgr, MessageHandler &msg_handler,
+                    Metrics &metrics, HouseWindow *house_window = nullptr);
 
     // House Management
-    void requestHouse();
-    void releaseHouse(int house_id_to_release);
+    void requestHouse(std::chrono::steady_clock::time_point now);
+    void releaseHouseLock();
     void handleHouseRequest(const Message &msg);
     void handleHouseReply(const Message &msg);
+    void handleHouseBusy(const Message &msg);
+    void handleHouseLockMessage(const Message &msg);
     void updateLocalHouseState(int house_id, int status);
     bool isHouseHeld() const;
     int getHeldHouseId() const;
     bool allHouseRepliesReceived() const;
+    // Per-house locks only: every free house this attempt could target answered HOUSE_BUSY.
+    bool houseRequestFailed() const { return per_house_locks && requesting_house && target_house_id == 0; }
+    bool usesPerHouseLocks() const { return per_house_locks; }
+    int getTargetHouseId() const { return target_house_id; }
     void recordHouseAcquired(int house_id);
     void recordHouseReleased();
     bool isRequestingHouse() const { return requesting_house; }
-    std::map<int, int> getHouseStates() const;
+    const HouseTable &getHouseTable() const { return house_table; }
+    int getLastHeldHouseId() const { return last_held_house_id; }
+    bool usesHouseWindow() const { return house_algorithm == MutexAlgorithm::HOUSE_WINDOW; }
+    // HOUSE_WINDOW only: claims a free house in the window, trying the preferred one first; 0 if none is free.
+    int claimHouse(int preferred_house_id);
 
-    // Paser Management
+    // Paser Management: Lamport's queue-based mutex generalised to k = P holders. Requests are acknowledged
+    // at once and every process keeps all outstanding requests ordered by (timestamp, id). A requester holds a
+    // paser once every peer has acknowledged and its request is among the first P; RELEASE_PASER frees the slot.
     void requestPaser();
     void releasePaser();
     void handlePaserRequest(const Message &msg);
     void handlePaserReply(const Message &msg);
+    void handlePaserRelease(const Message &msg);
     bool isPaserHeld() const;
-    bool sufficientPaserRepliesReceived() const;
+    bool isPaserGranted() const;
     void recordPaserAcquired();
     void recordPaserReleased();
     bool isRequestingPaser() const { return requesting_paser; }
 
-    std::pair<int, int> getMyPriority(ResourceType type);
-    void processDeferredQueues(ResourceType type);
+    std::pair<Timestamp, int> getMyPriority(ResourceType type);
+
+    // The failure detector gave up on peer_id: stop waiting for its replies, drop its queued paser requests and
+    // treat the houses it held as free. Mutual exclusion then rests on the suspicion being right.
+    void handlePeerSuspected(int peer_id);
 
-    std::mutex &getMutex() { return resource_mutex; }
 
 private:
     int my_id;
@@ -55,26 +79,64 @@ private:
 
     ClockManager &clock_manager;
     MessageHandler &message_handler;
+    Metrics &metrics;
+
+    // House lock: Ricart-Agrawala uses the reply set and deferred queue below, the other algorithms delegate.
+    // Only the selected algorithm's state is built; both keep O(N) vectors per process.
+    const MutexAlgorithm house_algorithm;
+    std::unique_ptr<MaekawaMutex> maekawa_mutex;
+    std::unique_ptr<SuzukiKasamiMutex> token_mutex;
+    // Only valid with Ricart-Agrawala, where a requester hears from every peer before choosing a house.
+    const bool piggyback_house_state;
+    // Ricart-Agrawala on one named house at a time instead of the pool. A higher priority requester of the same
+    // house defers the request like the pool lock does; only the holder answers HOUSE_BUSY, and the requester
+    // then moves on to another free house.
+    const bool per_house_locks;
+    const bool prefer_last_house;
+    // Piggybacking only: paser broadcasts carry their sender's house changes, so the table normally stays as
+    // fresh as UPDATE_HOUSE_STATE keeps it. A table that shows no free house and has heard nothing for this
+    // interval (the shortest work time) is re-checked by a request to every peer; other retries fail locally.
+    const std::chrono::steady_clock::duration stale_table_probe_interval;
+    std::chrono::steady_clock::time_point house_attempt_time;
+    std::chrono::steady_clock::time_point last_table_refresh;
+    bool table_news; // house entries merged from paser broadcasts since the last attempt
+    HouseWindow *const house_window;
+    std::vector<int> window_statuses;
 
     // House State
-    std::map<int, int> local_house_state;
+    HouseTable house_table;
     int held_house_id_val;
+    int last_held_house_id;
     bool requesting_house;
-    int house_request_timestamp;
-    std::set<int> house_replies_needed;
-    std::queue<int> house_deferred_queue;
+    Timestamp house_request_timestamp;
+    int target_house_id;
+    std::vector<std::uint64_t> houses_tried;
+    PeerSet house_replies_needed;
+    // (requester id, request timestamp). Per-house locks only defer requests for target_house_id, so the queue
+    // always belongs to that one house and is answered when it is released or abandoned.
+    std::queue<std::pair<int, Timestamp>> house_deferred_queue;
 
     // Paser State
     bool holding_paser_flag;
     bool requesting_paser;
-    int paser_request_timestamp;
-    std::set<int> paser_replies_needed;
-    std::queue<int> paser_deferred_queue;
-
-    std::mutex resource_mutex;
+    Timestamp paser_request_timestamp;
+    PeerSet paser_replies_needed;
+    std::set<std::pair<Timestamp, int>> paser_queue; // outstanding requests, own included, as (timestamp, id)
 
-    void log(const std::string &message_content) const;
-    void sendReply(int target_id, ResourceType resource_type);
-    void addToDeferredQueue(int sender_id, ResourceType resource_type);
+    template <typename... Args>
+    void log(LogLevel level, const Args &...args) const
+    {
+        if (Logger::enabled(level))
+        {
+            Logger::instance().write(level, "[ResMgr P", my_id, " C", clock_manager.getTime(), "] ", args...);
+        }
+    }
+    void requestTargetHouse();
+    bool echoesHouseRequest(const Message &msg) const;
+    std::vector<int> ownHouseEntry() const;
+    void sendReply(int target_id, ResourceType resource_type, Timestamp request_ts = 0, int house_id = 0);
+    void addToDeferredQueue(int sender_id, Timestamp request_ts);
+    void sendDeferredHouseReplies();
     void removeFromRepliesNeeded(int sender_id, ResourceType resource_type);
+    void resetRepliesNeeded(PeerSet &replies_needed);
 };
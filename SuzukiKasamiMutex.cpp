@@ -0,0 +1,115 @@
+#include "SuzukiKasamiMutex.h"
+
+#include <algorithm>
+
+SuzukiKasamiMutex::SuzukiKasamiMutex(int process_id, int n_procs, ClockManager &clock_mgr, MessageHandler &msg_handler)
+    : my_id(process_id), N_PROCESSES_CONST(n_procs), clock_manager(clock_mgr), message_handler(msg_handler),
+      request_numbers(n_procs + 1, 0), has_token(process_id == 1), in_critical_section(false),
+      token_last_served(n_procs + 1, 0)
+{
+    queued_ids.reset(n_procs, 0);
+    queued_ids.clear();
+}
+
+void SuzukiKasamiMutex::request()
+{
+    in_critical_section = true;
+    if (has_token)
+    {
+        log(LogLevel::DEBUG, "Token already held; entering without messages.");
+        return;
+    }
+    request_numbers[my_id]++;
+    log(LogLevel::DEBUG, "Broadcasting TOKEN_REQUEST #", request_numbers[my_id]);
+    message_handler.broadcastMessage(MessageType::TOKEN_REQUEST, -1, 0, 0, {request_numbers[my_id]});
+}
+
+void SuzukiKasamiMutex::release()
+{
+    in_critical_section = false;
+    if (!has_token)
+    {
+        return;
+    }
+    token_last_served[my_id] = request_numbers[my_id];
+    for (int id = 1; id <= N_PROCESSES_CONST; ++id)
+    {
+        bool outstanding = request_numbers[id] == token_last_served[id] + 1;
+        if (id != my_id && outstanding && !queued_ids.contains(id))
+        {
+            token_queue.push_back(id);
+            queued_ids.insert(id);
+        }
+    }
+    if (!token_queue.empty())
+    {
+        int next_id = token_queue.front();
+        token_queue.pop_front();
+        queued_ids.erase(next_id);
+        sendToken(next_id);
+    }
+}
+
+void SuzukiKasamiMutex::handleMessage(const Message &msg)
+{
+    if (msg.type == MessageType::TOKEN_REQUEST)
+    {
+        handleTokenRequest(msg);
+    }
+    else if (msg.type == MessageType::TOKEN)
+    {
+        handleToken(msg);
+    }
+}
+
+void SuzukiKasamiMutex::handleTokenRequest(const Message &msg)
+{
+    if (msg.payload.empty())
+    {
+        return;
+    }
+    int sender = msg.sender_id;
+    request_numbers[sender] = std::max(request_numbers[sender], msg.payload[0]);
+    log(LogLevel::DEBUG, "TOKEN_REQUEST #", msg.payload[0], " from ", sender);
+
+    if (has_token && !in_critical_section && request_numbers[sender] == token_last_served[sender] + 1)
+    {
+        sendToken(sender);
+    }
+}
+
+void SuzukiKasamiMutex::handleToken(const Message &msg)
+{
+    // Payload: LN[1..N], queue length, queue ids.
+    const std::vector<int> &p = msg.payload;
+    if (static_cast<int>(p.size()) < N_PROCESSES_CONST + 1)
+    {
+        log(LogLevel::ERROR, "Malformed token from ", msg.sender_id);
+        return;
+    }
+    std::copy(p.begin(), p.begin() + N_PROCESSES_CONST, token_last_served.begin() + 1);
+    int queue_length = p[N_PROCESSES_CONST];
+    token_queue.assign(p.begin() + N_PROCESSES_CONST + 1, p.begin() + N_PROCESSES_CONST + 1 + queue_length);
+    for (int id : token_queue)
+    {
+        queued_ids.insert(id);
+    }
+    has_token = true;
+    log(LogLevel::DEBUG, "Received token from ", msg.sender_id, ", queue length ", queue_length);
+}
+
+void SuzukiKasamiMutex::sendToken(int target_id)
+{
+    std::vector<int> payload(token_last_served.begin() + 1, token_last_served.end());
+    payload.push_back(static_cast<int>(token_queue.size()));
+    payload.insert(payload.end(), token_queue.begin(), token_queue.end());
+
+    has_token = false;
+    for (int id : token_queue)
+    {
+        queued_ids.erase(id);
+    }
+    token_queue.clear();
+    log(LogLevel::DEBUG, "Passing token to ", target_id);
+    message_handler.sendMessage(target_id - 1, MessageType::TOKEN, -1, 0, 0, payload);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "types.h"
+#include "Logger.h"
+#include "ClockManager.h"
+#include "MessageHandler.h"
+#include "PeerSet.h"
+
+// Suzuki-Kasami token-based mutual exclusion. The token carries LN (last satisfied request number per process)
+// and a FIFO queue of waiting processes; every process keeps RN, the highest request number seen from each peer.
+// The token starts at process 1. A holder re-enters with no messages; a contended entry costs N-1 requests + 1 token.
+class SuzukiKasamiMutex
+{
+public:
+    SuzukiKasamiMutex(int process_id, int n_procs, ClockManager &clock_mgr, MessageHandler &msg_handler);
+
+    void request();
+    void release();
+    bool isGranted() const { return in_critical_section && has_token; }
+    void handleMessage(const Message &msg);
+
+private:
+    int my_id;
+    const int N_PROCESSES_CONST;
+    ClockManager &clock_manager;
+    MessageHandler &message_handler;
+
+    std::vector<int> request_numbers; // RN, indexed by process id
+    bool has_token;
+    bool in_critical_section; // requested or inside the CS
+    std::vector<int> token_last_served; // LN, valid while has_token
+    std::deque<int> token_queue;        // Q, valid while has_token
+    PeerSet queued_ids;                 // the ids in Q, so release() can skip them in O(1)
+
+    void handleTokenRequest(const Message &msg);
+    void handleToken(const Message &msg);
+    void sendToken(int target_id);
+
+    template <typename... Args>
+    void log(LogLevel level, const Args &...args) const
+    {
+        if (Logger::enabled(level))
+        {
+            Logger::instance().write(level, "[Token P", my_id, " C", clock_manager.getTime(), "] ", args...);
+        }
+    }
+};
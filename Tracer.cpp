@@ -0,0 +1,175 @@
+#include "Tracer.h"
+
+#include <cstdio>
+#include <set>
+
+static thread_local bool thread_time_overridden = false;
+static thread_local std::chrono::steady_clock::time_point thread_time;
+
+static long long toMicros(std::chrono::steady_clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
+Tracer::Tracer() : active(false), capacity(0), dropped_events(0) {}
+
+Tracer &Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::start(size_t events_per_thread)
+{
+    capacity = events_per_thread;
+    active = true;
+}
+
+void Tracer::stop()
+{
+    active = false;
+    if (dropped_events.load() > 0)
+    {
+        std::fprintf(stderr, "Tracer: dropped %llu events (per-thread buffer full).\n", dropped_events.load());
+    }
+}
+
+void Tracer::setThreadTime(std::chrono::steady_clock::time_point now)
+{
+    thread_time_overridden = true;
+    thread_time = now;
+}
+
+std::chrono::steady_clock::time_point Tracer::now()
+{
+    return thread_time_overridden ? thread_time : std::chrono::steady_clock::now();
+}
+
+unsigned long long Tracer::flowId(int from_id, int to_id, MessageType type, Timestamp timestamp)
+{
+    unsigned long long id = static_cast<unsigned int>(from_id);
+    id = id * 1000003ULL ^ static_cast<unsigned int>(to_id);
+    id = id * 1000003ULL ^ static_cast<unsigned int>(type);
+    id = id * 1000003ULL ^ static_cast<unsigned long long>(timestamp);
+    return id;
+}
+
+Tracer::ThreadBuffer *Tracer::localBuffer()
+{
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = buffers.back().get();
+        buffer->events.reserve(capacity);
+    }
+    return buffer;
+}
+
+void Tracer::append(const Event &event)
+{
+    ThreadBuffer *buffer = localBuffer();
+    if (buffer->events.size() >= capacity)
+    {
+        dropped_events.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events.push_back(event);
+}
+
+void Tracer::recordState(int process_id, ProcessState state, std::chrono::steady_clock::time_point begin,
+                         std::chrono::steady_clock::time_point end, Timestamp clock)
+{
+    append({toMicros(begin), toMicros(end) - toMicros(begin), 0, process_id, clock, 0, Kind::STATE,
+            static_cast<unsigned char>(state), FlowPhase::NONE});
+}
+
+void Tracer::recordMessage(int process_id, bool is_send, int peer_id, MessageType type, Timestamp clock,
+                           FlowPhase flow_phase, unsigned long long flow_id)
+{
+    append({toMicros(now()), 1, flow_id, process_id, clock, peer_id, is_send ? Kind::SEND : Kind::RECEIVE,
+            static_cast<unsigned char>(type), flow_phase});
+}
+
+std::string Tracer::serializeEvents() const
+{
+    std::string out;
+    char line[512];
+    std::set<int> process_ids;
+    auto emit = [&out, &line](int length)
+    {
+        if (!out.empty())
+        {
+            out += ",\n";
+        }
+        out.append(line, length);
+    };
+
+    for (const auto &buffer : buffers)
+    {
+        for (const Event &event : buffer->events)
+        {
+            process_ids.insert(event.process_id);
+            if (event.kind == Kind::STATE)
+            {
+                emit(std::snprintf(line, sizeof(line),
+                                   "{\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"name\":\"%s\",\"ts\":%lld,\"dur\":%lld,"
+                                   "\"args\":{\"clock\":%lld}}",
+                                   event.process_id, processStateName(static_cast<ProcessState>(event.code)),
+                                   event.ts_us, event.dur_us, static_cast<long long>(event.clock)));
+                continue;
+            }
+            const char *type_name = messageTypeName(static_cast<MessageType>(event.code));
+            emit(std::snprintf(line, sizeof(line),
+                               "{\"ph\":\"X\",\"pid\":%d,\"tid\":1,\"name\":\"%s %s\",\"ts\":%lld,\"dur\":%lld,"
+                               "\"args\":{\"peer\":%d,\"clock\":%lld}}",
+                               event.process_id, event.kind == Kind::SEND ? "send" : "recv", type_name, event.ts_us,
+                               event.dur_us, event.peer_id, static_cast<long long>(event.clock)));
+            if (event.flow_phase != FlowPhase::NONE)
+            {
+                emit(std::snprintf(line, sizeof(line),
+                                   "{\"ph\":\"%c\",\"pid\":%d,\"tid\":1,\"name\":\"message\",\"cat\":\"msg\","
+                                   "\"id\":\"0x%llx\",\"ts\":%lld,\"bp\":\"e\"}",
+                                   static_cast<char>(event.flow_phase), event.process_id, event.flow_id, event.ts_us));
+            }
+        }
+    }
+
+    for (int process_id : process_ids)
+    {
+        emit(std::snprintf(line, sizeof(line),
+                           "{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":\"P%d\"}},\n"
+                           "{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_sort_index\",\"args\":{\"sort_index\":%d}},\n"
+                           "{\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"name\":\"thread_name\",\"args\":{\"name\":\"state\"}},\n"
+                           "{\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"name\":\"thread_name\",\"args\":{\"name\":\"messages\"}}",
+                           process_id, process_id, process_id, process_id, process_id, process_id));
+    }
+    return out;
+}
+
+bool Tracer::writeFile(const std::string &path, const std::vector<std::string> &event_chunks)
+{
+    FILE *out = std::fopen(path.c_str(), "w");
+    if (!out)
+    {
+        return false;
+    }
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out);
+    bool first = true;
+    for (const std::string &chunk : event_chunks)
+    {
+        if (chunk.empty())
+        {
+            continue;
+        }
+        if (!first)
+        {
+            std::fputs(",\n", out);
+        }
+        std::fwrite(chunk.data(), 1, chunk.size(), out);
+        first = false;
+    }
+    std::fputs("\n]}\n", out);
+    return std::fclose(out) == 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+// Chrome/Perfetto trace of state transitions and message traffic. Each thread appends fixed-size events to its
+// own preallocated buffer without locking; serialization happens once every thread has stopped.
+// pid is the logical process id, tid 0 carries ProcessState slices and tid 1 carries sends and receives.
+class Tracer
+{
+public:
+    enum class FlowPhase : char
+    {
+        NONE = 0,
+        START = 's',
+        STEP = 't',
+        FINISH = 'f'
+    };
+
+    static Tracer &instance();
+
+    void start(size_t events_per_thread);
+    void stop();
+
+    static bool enabled() { return instance().active.load(std::memory_order_relaxed); }
+
+    // Timestamps are microseconds since the steady clock's epoch, which every rank on a node shares.
+    // A driver stepping processes in virtual time (the simulator) overrides the clock for its thread.
+    static void setThreadTime(std::chrono::steady_clock::time_point now);
+    static std::chrono::steady_clock::time_point now();
+
+    void recordState(int process_id, ProcessState state, std::chrono::steady_clock::time_point begin,
+                     std::chrono::steady_clock::time_point end, Timestamp clock);
+    void recordMessage(int process_id, bool is_send, int peer_id, MessageType type, Timestamp clock,
+                       FlowPhase flow_phase, unsigned long long flow_id);
+
+    // Comma-separated trace events of this process (no enclosing array); empty if nothing was recorded.
+    std::string serializeEvents() const;
+    static bool writeFile(const std::string &path, const std::vector<std::string> &event_chunks);
+
+    static unsigned long long flowId(int from_id, int to_id, MessageType type, Timestamp timestamp);
+
+private:
+    enum class Kind : unsigned char
+    {
+        STATE,
+        SEND,
+        RECEIVE
+    };
+
+    struct Event
+    {
+        long long ts_us;
+        long long dur_us;
+        unsigned long long flow_id;
+        int process_id;
+        Timestamp clock;
+        int peer_id;
+        Kind kind;
+        unsigned char code; // ProcessState or MessageType
+        FlowPhase flow_phase;
+    };
+
+    struct ThreadBuffer
+    {
+        std::vector<Event> events; // reserved up front, never grows
+    };
+
+    Tracer();
+
+    std::atomic<bool> active;
+    size_t capacity;
+    std::atomic<unsigned long long> dropped_events;
+
+    std::mutex buffers_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    ThreadBuffer *localBuffer();
+    void append(const Event &event);
+};
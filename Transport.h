@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+// One coalesced batch of protocol messages addressed to a single rank; see MessageHandler for the word layout.
+struct TransportBatch
+{
+    int target_rank;
+    std::vector<int> words;
+};
+
+// Moves batches of ints between ranks. MessageHandler owns the protocol encoding, the send thread and the
+// listener thread; a Transport only delivers whole batches in per-sender FIFO order.
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    // Called from the send thread. Hands every batch to the network without waiting for any peer to take it;
+    // batches may be moved from.
+    virtual void sendBatches(std::vector<TransportBatch> &batches) = 0;
+    // Send thread only. Transports whose sends are done when sendBatches() returns keep these defaults; the others
+    // finish their outstanding sends here. reapSends() returns true while some are still in flight.
+    virtual bool reapSends() { return false; }
+    virtual void waitSends() {}
+
+    // Receive side, all called from the listener thread except wakeReceiver().
+    virtual void startReceiving(int max_batch_words) = 0;
+    // Blocks until at least one batch has arrived. Returns false once wakeReceiver() has been called.
+    virtual bool waitForBatches() = 0;
+    // Next batch that has already arrived, or nullptr. The batch stays valid until releaseBatch().
+    virtual const int *nextBatch() = 0;
+    virtual void releaseBatch() = 0;
+    virtual void stopReceiving() = 0;
+    virtual void wakeReceiver() = 0;
+
+    // Non-blocking barrier across every rank of the transport, used once at shutdown.
+    virtual void startBarrier() = 0;
+    virtual bool testBarrier() = 0;
+    virtual void waitBarrier() = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "Transport.h"
+
+// Batches for several ranks behind one relay (a hybrid rank's dispatcher, a node leader), packed so that the
+// slow link is crossed once per flush and identical batches (a broadcast) are carried only once:
+//   [part count, then per part: target count, targets..., batch length, batch words...]
+// Targets are written relative to a base rank. The relay delivers parts in bundle order, so per-target FIFO
+// order holds as long as every batch from one sender to one target takes the same route.
+namespace TransportBundle
+{
+    // Packs batches[indices] into bundles of at most max_words words each (a single part may exceed it) and
+    // appends them to bundles. Every target must lie in [target_base, target_base + target_span).
+    inline void pack(const std::vector<TransportBatch> &batches, const std::vector<size_t> &indices, int target_base,
+                     int target_span, size_t max_words, std::vector<std::vector<int>> &bundles)
+    {
+        // A batch equal to an earlier part joins that part's targets, unless its target already has a part here:
+        // delivering it at the earlier position would then overtake that target's preceding batch.
+        std::vector<std::pair<size_t, std::vector<int>>> parts; // (batch index, relative targets)
+        std::vector<bool> target_seen(target_span, false);
+        for (size_t index : indices)
+        {
+            int target = batches[index].target_rank - target_base;
+            bool merged = false;
+            if (!target_seen[target])
+            {
+                for (auto &part : parts)
+                {
+                    if (batches[part.first].words == batches[index].words)
+                    {
+                        part.second.push_back(target);
+                        merged = true;
+                        break;
+                    }
+                }
+                target_seen[target] = true;
+            }
+            if (!merged)
+            {
+                parts.push_back({index, {target}});
+            }
+        }
+
+        std::vector<int> *bundle = nullptr;
+        for (const auto &part : parts)
+        {
+            const std::vector<int> &words = batches[part.first].words;
+            size_t part_words = 2 + part.second.size() + words.size();
+            if (!bundle || (bundle->size() > 1 && bundle->size() + part_words > max_words))
+            {
+                bundles.emplace_back(1, 0);
+                bundle = &bundles.back();
+            }
+            (*bundle)[0]++;
+            bundle->push_back(static_cast<int>(part.second.size()));
+            bundle->insert(bundle->end(), part.second.begin(), part.second.end());
+            bundle->push_back(static_cast<int>(words.size()));
+            bundle->insert(bundle->end(), words.begin(), words.end());
+        }
+    }
+
+    // Calls deliver(relative target, batch words, batch length) for every target of every part, in order.
+    template <typename Deliver>
+    void unpack(const int *bundle, Deliver &&deliver)
+    {
+        const int *cursor = bundle + 1;
+        for (int part = 0; part < bundle[0]; ++part)
+        {
+            int target_count = cursor[0];
+            const int *targets = cursor + 1;
+            int length = targets[target_count];
+            const int *words = targets + target_count + 1;
+            for (int i = 0; i < target_count; ++i)
+            {
+                deliver(targets[i], words, length);
+            }
+            cursor = words + length;
+        }
+    }
+}
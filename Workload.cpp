@@ -0,0 +1,379 @@
+#include "Workload.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    std::chrono::microseconds scaledMillis(double ms, double time_scale)
+    {
+        return std::chrono::microseconds(static_cast<long long>(ms * time_scale * 1000.0));
+    }
+
+    // Work times: uniform over [work_min_ms, work_max_ms] whole milliseconds, or Pareto with scale work_min_ms.
+    class WorkSampler
+    {
+    public:
+        WorkSampler(const SimConfig &config, std::mt19937 &random)
+            : rng(random), uniform(config.work_min_ms, config.work_max_ms), pareto_alpha(config.work_pareto_alpha),
+              pareto_scale_ms(config.work_min_ms), time_scale(config.time_scale) {}
+
+        std::chrono::microseconds sample()
+        {
+            if (pareto_alpha > 0.0)
+            {
+                // Inverse transform; 1 - u keeps the base away from zero.
+                double u = 1.0 - std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+                return scaledMillis(pareto_scale_ms * std::pow(u, -1.0 / pareto_alpha), time_scale);
+            }
+            return scaledMillis(uniform(rng), time_scale);
+        }
+
+    private:
+        std::mt19937 &rng;
+        std::uniform_int_distribution<int> uniform;
+        double pareto_alpha;
+        double pareto_scale_ms;
+        double time_scale;
+    };
+
+    class ClosedLoopWorkload : public Workload
+    {
+    public:
+        ClosedLoopWorkload(const SimConfig &config, std::mt19937 &random)
+            : rng(random), think(1.0 / (config.think_mean_ms * config.time_scale)), work(config, random) {}
+
+        bool isOpenLoop() const override { return false; }
+
+        bool next(TimePoint now, WorkloadJob &job) override
+        {
+            job.arrival = now + scaledMillis(think(rng), 1.0);
+            job.work = work.sample();
+            return true;
+        }
+
+    private:
+        std::mt19937 &rng;
+        std::exponential_distribution<double> think; // milliseconds, already scaled
+        WorkSampler work;
+    };
+
+    // POISSON is the special case burst_factor = 1: one phase, one rate.
+    class ModulatedPoissonWorkload : public Workload
+    {
+    public:
+        ModulatedPoissonWorkload(const SimConfig &config, double factor, std::mt19937 &random)
+            : rng(random), burst_factor(factor),
+              // Calm and burst phases last equally long on average, so the mean gap stays think_mean_ms.
+              calm_gap(2.0 / (config.think_mean_ms * config.time_scale * (1.0 + factor))),
+              burst_gap(2.0 * factor / (config.think_mean_ms * config.time_scale * (1.0 + factor))),
+              phase(1.0 / (config.burst_period_ms * config.time_scale)), work(config, random), started(false),
+              in_burst(false) {}
+
+        bool isOpenLoop() const override { return true; }
+
+        bool next(TimePoint, WorkloadJob &job) override
+        {
+            if (!started)
+            {
+                started = true;
+                last_arrival = origin;
+                phase_end = burst_factor != 1.0 ? origin + scaledMillis(phase(rng), 1.0) : TimePoint::max();
+            }
+            // Exponential gaps are memoryless, so a gap that crosses the phase end is simply redrawn from there.
+            while (true)
+            {
+                TimePoint arrival = last_arrival + scaledMillis((in_burst ? burst_gap : calm_gap)(rng), 1.0);
+                if (arrival <= phase_end)
+                {
+                    last_arrival = arrival;
+                    break;
+                }
+                last_arrival = phase_end;
+                in_burst = !in_burst;
+                phase_end = last_arrival + scaledMillis(phase(rng), 1.0);
+            }
+            job.arrival = last_arrival;
+            job.work = work.sample();
+            return true;
+        }
+
+    private:
+        std::mt19937 &rng;
+        double burst_factor;
+        std::exponential_distribution<double> calm_gap;  // milliseconds, already scaled
+        std::exponential_distribution<double> burst_gap; // milliseconds, already scaled
+        std::exponential_distribution<double> phase;     // milliseconds, already scaled
+        WorkSampler work;
+        bool started;
+        bool in_burst;
+        TimePoint last_arrival;
+        TimePoint phase_end;
+    };
+
+    struct TraceRecord
+    {
+        std::uint32_t process;
+        std::uint32_t work_us;
+        std::uint64_t arrival_us;
+    };
+    static_assert(sizeof(TraceRecord) == 16, "trace records are 16 bytes on disk");
+
+    class TraceWorkload : public Workload
+    {
+    public:
+        TraceWorkload(const std::string &path, int id, double scale, std::string &error)
+            : process_id(id), time_scale(scale), data(nullptr), size(0), cursor(0), released(0), binary(false)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            struct stat info;
+            if (fd < 0 || ::fstat(fd, &info) != 0)
+            {
+                error = "cannot open trace " + path + ": " + std::strerror(errno);
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+                return;
+            }
+            size = static_cast<size_t>(info.st_size);
+            void *mapping = size > 0 ? ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+            ::close(fd);
+            if (mapping == MAP_FAILED)
+            {
+                error = "cannot map trace " + path + (size == 0 ? ": empty file" : std::string(": ") + std::strerror(errno));
+                size = 0;
+                return;
+            }
+            data = static_cast<const char *>(mapping);
+
+            std::uint32_t header[2] = {0, 0};
+            std::memcpy(header, data, std::min(size, sizeof(header)));
+            binary = size >= sizeof(header) && header[0] == TRACE_MAGIC;
+            if (binary && header[1] != 1)
+            {
+                error = "unsupported binary trace version in " + path;
+                unmap();
+                return;
+            }
+            cursor = binary ? findBinaryGroup() : findCsvGroup();
+            released = cursor;
+        }
+
+        ~TraceWorkload() override { unmap(); }
+
+        bool isOpen() const { return data != nullptr; }
+        bool isOpenLoop() const override { return true; }
+
+        bool next(TimePoint, WorkloadJob &job) override
+        {
+            double arrival_us = 0.0;
+            double work_us = 0.0;
+            if (!(binary ? readBinary(arrival_us, work_us) : readCsv(arrival_us, work_us)))
+            {
+                return false;
+            }
+            job.arrival = origin + std::chrono::microseconds(static_cast<long long>(arrival_us * time_scale));
+            job.work = std::chrono::microseconds(static_cast<long long>(work_us * time_scale));
+            releaseConsumed();
+            return true;
+        }
+
+    private:
+        // Consumed pages are dropped in steps of this many bytes; they are clean, so the kernel just forgets them.
+        static const size_t RELEASE_BYTES = 1 << 20;
+        static const size_t BINARY_HEADER_BYTES = 8;
+
+        int process_id;
+        double time_scale;
+        const char *data;
+        size_t size;
+        size_t cursor; // next unread record or line of this process's group
+        size_t released;
+        bool binary;
+
+        void unmap()
+        {
+            if (data)
+            {
+                ::munmap(const_cast<char *>(data), size);
+                data = nullptr;
+            }
+        }
+
+        size_t recordCount() const { return (size - BINARY_HEADER_BYTES) / sizeof(TraceRecord); }
+
+        TraceRecord recordAt(size_t index) const
+        {
+            TraceRecord record;
+            std::memcpy(&record, data + BINARY_HEADER_BYTES + index * sizeof(TraceRecord), sizeof(record));
+            return record;
+        }
+
+        size_t findBinaryGroup() const
+        {
+            size_t low = 0;
+            size_t high = recordCount();
+            while (low < high)
+            {
+                size_t mid = low + (high - low) / 2;
+                if (static_cast<int>(recordAt(mid).process) < process_id)
+                {
+                    low = mid + 1;
+                }
+                else
+                {
+                    high = mid;
+                }
+            }
+            return BINARY_HEADER_BYTES + low * sizeof(TraceRecord);
+        }
+
+        bool readBinary(double &arrival_us, double &work_us)
+        {
+            if (cursor + sizeof(TraceRecord) > size)
+            {
+                return false;
+            }
+            TraceRecord record = recordAt((cursor - BINARY_HEADER_BYTES) / sizeof(TraceRecord));
+            if (static_cast<int>(record.process) != process_id)
+            {
+                return false;
+            }
+            cursor += sizeof(TraceRecord);
+            arrival_us = static_cast<double>(record.arrival_us);
+            work_us = static_cast<double>(record.work_us);
+            return true;
+        }
+
+        // Start of the first line at or after offset.
+        size_t lineStartFrom(size_t offset, size_t first_line) const
+        {
+            if (offset <= first_line || data[offset - 1] == '\n')
+            {
+                return std::max(offset, first_line);
+            }
+            const void *newline = std::memchr(data + offset, '\n', size - offset);
+            return newline ? static_cast<size_t>(static_cast<const char *>(newline) - data) + 1 : size;
+        }
+
+        // Non-negative decimal with an optional fraction; the scan never leaves the mapping.
+        bool parseNumber(size_t &offset, double &value) const
+        {
+            while (offset < size && (data[offset] == ' ' || data[offset] == '\t'))
+            {
+                ++offset;
+            }
+            size_t begin = offset;
+            value = 0.0;
+            while (offset < size && data[offset] >= '0' && data[offset] <= '9')
+            {
+                value = value * 10.0 + (data[offset++] - '0');
+            }
+            if (offset < size && data[offset] == '.')
+            {
+                double unit = 0.1;
+                for (++offset; offset < size && data[offset] >= '0' && data[offset] <= '9'; ++offset, unit /= 10.0)
+                {
+                    value += (data[offset] - '0') * unit;
+                }
+            }
+            return offset > begin;
+        }
+
+        int processOfLine(size_t offset) const
+        {
+            double process = 0.0;
+            return offset < size && parseNumber(offset, process) ? static_cast<int>(process) : -1;
+        }
+
+        size_t findCsvGroup() const
+        {
+            // A first line that does not start with a digit is a header.
+            size_t first_line = size > 0 && (data[0] < '0' || data[0] > '9') ? lineStartFrom(1, 0) : 0;
+            // Binary search over byte offsets: the process id of the line starting at or after an offset never
+            // decreases with the offset.
+            size_t low = first_line;
+            size_t high = size;
+            while (low < high)
+            {
+                size_t mid = low + (high - low) / 2;
+                size_t line = lineStartFrom(mid, first_line);
+                if (line < size && processOfLine(line) < process_id)
+                {
+                    low = mid + 1;
+                }
+                else
+                {
+                    high = mid;
+                }
+            }
+            return lineStartFrom(low, first_line);
+        }
+
+        bool readCsv(double &arrival_us, double &work_us)
+        {
+            size_t offset = cursor;
+            double process = 0.0;
+            double arrival_ms = 0.0;
+            double work_ms = 0.0;
+            if (offset >= size || !parseNumber(offset, process) || static_cast<int>(process) != process_id ||
+                offset >= size || data[offset++] != ',' || !parseNumber(offset, arrival_ms) ||
+                offset >= size || data[offset++] != ',' || !parseNumber(offset, work_ms))
+            {
+                return false;
+            }
+            cursor = lineStartFrom(offset, 0);
+            arrival_us = arrival_ms * 1000.0;
+            work_us = work_ms * 1000.0;
+            return true;
+        }
+
+        void releaseConsumed()
+        {
+            static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            if (cursor - released < RELEASE_BYTES)
+            {
+                return;
+            }
+            size_t from = released / page * page;
+            size_t to = cursor / page * page;
+            if (to > from)
+            {
+                ::madvise(const_cast<char *>(data) + from, to - from, MADV_DONTNEED);
+            }
+            released = cursor;
+        }
+    };
+}
+
+std::unique_ptr<Workload> makeWorkload(const SimConfig &config, int process_id, std::mt19937 &rng, std::string &error)
+{
+    switch (config.workload)
+    {
+    case WorkloadKind::POISSON:
+        return std::make_unique<ModulatedPoissonWorkload>(config, 1.0, rng);
+    case WorkloadKind::BURSTY:
+        return std::make_unique<ModulatedPoissonWorkload>(config, config.burst_factor, rng);
+    case WorkloadKind::TRACE:
+    {
+        auto trace = std::make_unique<TraceWorkload>(config.trace_path, process_id, config.time_scale, error);
+        if (!trace->isOpen())
+        {
+            return nullptr;
+        }
+        return trace;
+    }
+    default:
+        return std::make_unique<ClosedLoopWorkload>(config, rng);
+    }
+}
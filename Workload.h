@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "types.h"
+
+// One critical-section cycle: when the job arrived and how long it works once it holds a house and a paser.
+struct WorkloadJob
+{
+    std::chrono::steady_clock::time_point arrival;
+    std::chrono::microseconds work;
+};
+
+// Where a process's cycles come from. A closed-loop source places each arrival a think time after the process
+// became free, so load drops as latency grows. Open-loop sources fix arrivals in advance: a job that arrives
+// while the process is still busy waits, and that wait is queueing delay rather than think time.
+//
+// A TRACE file lists every job of every process, grouped by process id (ascending), each group in arrival order.
+// It is memory-mapped, and each process binary-searches for its own group and streams through it, releasing
+// pages it has consumed, so neither the file size nor the process count shows up in resident memory. Two forms:
+//   CSV:    one "process,arrival_ms,work_ms" line per job, times may have fractions; an optional header line
+//   binary: uint32 TRACE_MAGIC, uint32 version 1, then 16-byte records {uint32 process, uint32 work_us,
+//           uint64 arrival_us} in host byte order
+// Times count from the start of the run and are multiplied by time_scale like every other duration.
+class Workload
+{
+public:
+    static const unsigned int TRACE_MAGIC = 0x505a5731; // "PZW1"
+
+    virtual ~Workload() = default;
+
+    virtual bool isOpenLoop() const = 0;
+    // Open-loop arrival times are relative to origin; call once before the first next().
+    void start(std::chrono::steady_clock::time_point run_start) { origin = run_start; }
+    // The next job for a process that became free at now; false once the source is exhausted.
+    virtual bool next(std::chrono::steady_clock::time_point now, WorkloadJob &job) = 0;
+
+protected:
+    std::chrono::steady_clock::time_point origin;
+};
+
+// Builds the source selected by config.workload; draws come from rng. Null if the trace cannot be read, with
+// the reason in error.
+std::unique_ptr<Workload> makeWorkload(const SimConfig &config, int process_id, std::mt19937 &rng, std::string &error);
@@ -0,0 +1,98 @@
+// Compares reply tracking with std::set<int> against PeerSet for growing process counts.
+// Each round mirrors one request: refill with N-1 peers, erase them in arrival order, poll for completion.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "PeerSet.h"
+
+static std::atomic<unsigned long long> allocation_count{0};
+
+void *operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+struct Result
+{
+    double ns_per_round;
+    double allocs_per_round;
+};
+
+template <typename Round>
+static Result measure(int rounds, Round round)
+{
+    round(); // warm-up, lets PeerSet size its storage once
+    unsigned long long allocs_before = allocation_count.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r)
+    {
+        round();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    unsigned long long allocs = allocation_count.load() - allocs_before;
+    return {static_cast<double>(elapsed) / rounds, static_cast<double>(allocs) / rounds};
+}
+
+int main()
+{
+    const int my_id = 1;
+    const int sizes[] = {8, 64, 512, 4096, 16384};
+
+    std::printf("%8s %16s %16s %16s %16s %8s\n", "N", "set ns/round", "set allocs", "bitset ns/round", "bitset allocs", "speedup");
+    for (int n : sizes)
+    {
+        std::vector<int> arrival_order(n - 1);
+        std::iota(arrival_order.begin(), arrival_order.end(), 2);
+        std::shuffle(arrival_order.begin(), arrival_order.end(), std::mt19937(42));
+        int rounds = std::max(20, 2000000 / n);
+        volatile int sink = 0;
+
+        std::set<int> tree;
+        Result tree_result = measure(rounds, [&]()
+                                     {
+            tree.clear();
+            for (int i = 1; i <= n; ++i)
+            {
+                if (i != my_id)
+                {
+                    tree.insert(i);
+                }
+            }
+            for (int id : arrival_order)
+            {
+                tree.erase(id);
+                sink = sink + tree.empty();
+            } });
+
+        PeerSet bits;
+        Result bits_result = measure(rounds, [&]()
+                                     {
+            bits.reset(n, my_id);
+            for (int id : arrival_order)
+            {
+                bits.erase(id);
+                sink = sink + bits.empty();
+            } });
+
+        std::printf("%8d %16.0f %16.1f %16.0f %16.1f %7.1fx\n", n, tree_result.ns_per_round, tree_result.allocs_per_round,
+                    bits_result.ns_per_round, bits_result.allocs_per_round, tree_result.ns_per_round / bits_result.ns_per_round);
+    }
+    return 0;
+}
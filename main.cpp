@@ -5,17 +5,881 @@
 #include <mutex>
 #include <chrono>
 #include <mpi.h>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
 
 #include "types.h"
+#include "Logger.h"
 #include "ProcessLogic.h"
+#include "Workload.h"
+#include "MpiTransport.h"
+#include "InProcessTransport.h"
+#include "HybridTransport.h"
+#include "MpiHouseWindow.h"
+#include "DiscreteEventSimulator.h"
+#include "ReplayDriver.h"
+
+// Command-line options that are not part of the simulated protocol.
+struct RunOptions
+{
+    bool benchmark_mode = false;
+    std::string log_level;
+    std::string log_overflow;
+    enum class Backend
+    {
+        MPI,
+        IN_PROCESS,
+        SIMULATED,
+        HYBRID
+    };
+    Backend backend = Backend::MPI;
+    int processes_per_rank = 4;
+    int ranks_per_node = 0;
+    LatencyModel latency;
+    StallSpec stall;
+    std::string metrics_path;
+    std::string trace_path;
+    size_t trace_events_per_thread = 1 << 16;
+    std::string record_prefix; // every process writes <prefix>.p<id>.bin
+    std::string replay_path;
+    int replay_passes = 1000;
+};
+
+static void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --houses D               number of houses (default " << D_HOUSES_DEFAULT << ")\n"
+              << "  --pasers P               number of pasers (default " << P_PASERS_DEFAULT << ")\n"
+              << "  --work-ms MIN:MAX        critical-section time, uniform (default 4000:5000)\n"
+              << "  --work-pareto ALPHA      critical-section times Pareto with scale MIN and shape ALPHA\n"
+              << "  --think-ms MEAN          think time between cycles, exponential (default 200); open-loop\n"
+              << "                           workloads use it as the mean gap between arrivals\n"
+              << "  --workload closed|poisson|bursty[:FACTOR:PERIOD_MS]|trace:PATH\n"
+              << "                           closed (default) thinks after each cycle; the others are open loop:\n"
+              << "                           bursty alternates calm and FACTOR times faster phases of PERIOD_MS\n"
+              << "                           mean length (default 10:5000); trace reads per-process arrival\n"
+              << "                           and work times from a CSV or binary file, see Workload.h\n"
+              << "  --cycles N               critical-section entries per process, 0 = unlimited\n"
+              << "  --time-scale F           multiply every work and think time by F\n"
+              << "  --duration S             wall-clock limit in seconds (default 600)\n"
+              << "  --house-algorithm ra|maekawa|token|window\n"
+              << "                           window claims houses by compare-and-swap on a shared table (MPI RMA\n"
+              << "                           window on rank 0 across ranks) instead of exchanging lock messages\n"
+              << "  --house-locks per-house|pool\n"
+              << "                           ra locks each house separately by default; pool locks the whole pool\n"
+              << "  --prefer-last-house\n"
+              << "  --piggyback-house-state\n"
+              << "  --clock lamport|hlc       hlc packs wall-clock milliseconds with a logical counter\n"
+              << "  --heartbeat-ms MS        heartbeat period of the failure detector, 0 = off (default);\n"
+              << "                           a peer silent for four periods is no longer waited for and its houses\n"
+              << "                           and paser slots count as free. UNSAFE if that peer is only slow: two\n"
+              << "                           processes can then hold one house (see --stall)\n"
+              << "  --log-level debug|info|warn|error|off\n"
+              << "  --log-overflow drop|block|spill\n"
+              << "                           when a thread's log ring is full: drop the line (default), wait for\n"
+              << "                           the writer (default for sim, whose virtual time does not notice) or\n"
+              << "                           keep it on the heap\n"
+              << "  --benchmark              print throughput and entry-latency percentiles at exit\n"
+              << "  --transport mpi|inproc|sim|hybrid\n"
+              << "                           inproc runs every process as threads of one executable, no mpirun;\n"
+              << "                           sim is a single-threaded discrete-event run in virtual time;\n"
+              << "                           hybrid hosts several processes as threads of every MPI rank\n"
+              << "  --processes-per-rank K   logical processes per MPI rank for hybrid (default 4)\n"
+              << "  --ranks-per-node K       treat every K consecutive ranks as one node for mpi; 0 (default) groups\n"
+              << "                           the ranks that share memory\n"
+              << "  --processes N            number of processes for inproc and sim (default " << N_PROCESSES_DEFAULT << ")\n"
+              << "  --seed S                 seed for think/work times and simulated latencies (sim default 1)\n"
+              << "  --latency MODEL          sim one-way delay in us: fixed:US, uniform:MIN:MAX, exp:BASE:MEAN\n"
+              << "  --stall ID:AT_MS:FOR_MS  sim holds back process ID from virtual AT_MS for FOR_MS; sim always\n"
+              << "                           reports mutual exclusion violations\n"
+              << "  --metrics-json PATH      write message counters and latency histograms of every process\n"
+              << "  --trace PATH             write a Chrome/Perfetto trace of state changes and messages\n"
+              << "  --trace-events N         trace buffer size per thread, in events (default 65536)\n"
+              << "  --record PREFIX          write a replay log of every process to PREFIX.p<id>.bin\n"
+              << "  --replay PATH            re-run one replay log offline and report the CPU cost per message\n"
+              << "  --replay-passes N        passes over the log for --replay (default 1000)\n";
+}
+
+// Opens the trace once up front, so a bad path is reported instead of every process silently running no cycles.
+static bool traceReadable(const SimConfig &config)
+{
+    if (config.workload != WorkloadKind::TRACE)
+    {
+        return true;
+    }
+    std::mt19937 unused_rng;
+    std::string error;
+    if (!makeWorkload(config, 1, unused_rng, error))
+    {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Numeric flag values must be consumed whole: "3x" or "abc" is an error, not 3 or 0.
+static bool parseInt(const char *text, int &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX)
+    {
+        return false;
+    }
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+static bool parseUnsigned(const char *text, unsigned long long &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    // strtoull would quietly wrap a leading minus sign.
+    value = std::strtoull(text, &end, 10);
+    return end != text && *end == '\0' && errno != ERANGE && std::strchr(text, '-') == nullptr;
+}
+
+static bool parseDouble(const char *text, double &value)
+{
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtod(text, &end);
+    return end != text && *end == '\0' && errno != ERANGE;
+}
+
+static bool parseArguments(int argc, char *argv[], SimConfig &config, RunOptions &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--prefer-last-house")
+        {
+            config.prefer_last_house = true;
+        }
+        else if (arg == "--piggyback-house-state")
+        {
+            config.piggyback_house_state = true;
+        }
+        else if (arg == "--benchmark")
+        {
+            options.benchmark_mode = true;
+        }
+        else if (arg == "--house-algorithm" && has_value)
+        {
+            std::string name = argv[++i];
+            if (name == "ra")
+            {
+                config.house_algorithm = MutexAlgorithm::RICART_AGRAWALA;
+            }
+            else if (name == "maekawa")
+            {
+                config.house_algorithm = MutexAlgorithm::MAEKAWA;
+            }
+            else if (name == "token")
+            {
+                config.house_algorithm = MutexAlgorithm::SUZUKI_KASAMI;
+            }
+            else if (name == "window")
+            {
+                config.house_algorithm = MutexAlgorithm::HOUSE_WINDOW;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--house-locks" && has_value)
+        {
+            std::string scope = argv[++i];
+            if (scope == "per-house")
+            {
+                config.house_locks = HouseLockScope::PER_HOUSE;
+            }
+            else if (scope == "pool")
+            {
+                config.house_locks = HouseLockScope::POOL;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--clock" && has_value)
+        {
+            std::string mode = argv[++i];
+            if (mode == "lamport")
+            {
+                config.clock_mode = ClockMode::LAMPORT;
+            }
+            else if (mode == "hlc")
+            {
+                config.clock_mode = ClockMode::HYBRID;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--heartbeat-ms" && has_value)
+        {
+            if (!parseInt(argv[++i], config.heartbeat_ms))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--houses" && has_value)
+        {
+            if (!parseInt(argv[++i], config.d_houses))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--pasers" && has_value)
+        {
+            if (!parseInt(argv[++i], config.p_pasers))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--work-ms" && has_value)
+        {
+            int consumed = 0;
+            const char *value = argv[++i];
+            if (std::sscanf(value, "%d:%d%n", &config.work_min_ms, &config.work_max_ms, &consumed) != 2 ||
+                value[consumed] != '\0')
+            {
+                return false;
+            }
+        }
+        else if (arg == "--work-pareto" && has_value)
+        {
+            if (!parseDouble(argv[++i], config.work_pareto_alpha))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--workload" && has_value)
+        {
+            std::string name = argv[++i];
+            if (name == "closed")
+            {
+                config.workload = WorkloadKind::CLOSED_LOOP;
+            }
+            else if (name == "poisson")
+            {
+                config.workload = WorkloadKind::POISSON;
+            }
+            else if (name.rfind("bursty", 0) == 0)
+            {
+                config.workload = WorkloadKind::BURSTY;
+                int consumed = 0;
+                if (name != "bursty" &&
+                    (std::sscanf(name.c_str(), "bursty:%lf:%lf%n", &config.burst_factor, &config.burst_period_ms,
+                                 &consumed) != 2 ||
+                     name[consumed] != '\0'))
+                {
+                    return false;
+                }
+            }
+            else if (name.rfind("trace:", 0) == 0 && name.size() > 6)
+            {
+                config.workload = WorkloadKind::TRACE;
+                config.trace_path = name.substr(6);
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--think-ms" && has_value)
+        {
+            if (!parseDouble(argv[++i], config.think_mean_ms))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--cycles" && has_value)
+        {
+            if (!parseInt(argv[++i], config.target_cycles))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--time-scale" && has_value)
+        {
+            if (!parseDouble(argv[++i], config.time_scale))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--duration" && has_value)
+        {
+            if (!parseInt(argv[++i], config.run_seconds))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--log-level" && has_value)
+        {
+            options.log_level = argv[++i];
+        }
+        else if (arg == "--log-overflow" && has_value)
+        {
+            options.log_overflow = argv[++i];
+            LogOverflow policy;
+            if (!Logger::parseOverflow(options.log_overflow, policy))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--transport" && has_value)
+        {
+            std::string name = argv[++i];
+            if (name == "mpi")
+            {
+                options.backend = RunOptions::Backend::MPI;
+            }
+            else if (name == "inproc")
+            {
+                options.backend = RunOptions::Backend::IN_PROCESS;
+            }
+            else if (name == "sim")
+            {
+                options.backend = RunOptions::Backend::SIMULATED;
+            }
+            else if (name == "hybrid")
+            {
+                options.backend = RunOptions::Backend::HYBRID;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (arg == "--metrics-json" && has_value)
+        {
+            options.metrics_path = argv[++i];
+        }
+        else if (arg == "--trace" && has_value)
+        {
+            options.trace_path = argv[++i];
+        }
+        else if (arg == "--trace-events" && has_value)
+        {
+            unsigned long long events = 0;
+            if (!parseUnsigned(argv[++i], events))
+            {
+                return false;
+            }
+            options.trace_events_per_thread = static_cast<size_t>(events);
+        }
+        else if (arg == "--record" && has_value)
+        {
+            options.record_prefix = argv[++i];
+        }
+        else if (arg == "--replay" && has_value)
+        {
+            options.replay_path = argv[++i];
+        }
+        else if (arg == "--replay-passes" && has_value)
+        {
+            if (!parseInt(argv[++i], options.replay_passes))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--seed" && has_value)
+        {
+            if (!parseUnsigned(argv[++i], config.seed))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--latency" && has_value)
+        {
+            if (!LatencyModel::parse(argv[++i], options.latency))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--stall" && has_value)
+        {
+            if (!StallSpec::parse(argv[++i], options.stall))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--processes" && has_value)
+        {
+            if (!parseInt(argv[++i], config.n_processes))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--processes-per-rank" && has_value)
+        {
+            if (!parseInt(argv[++i], options.processes_per_rank))
+            {
+                return false;
+            }
+        }
+        else if (arg == "--ranks-per-node" && has_value)
+        {
+            if (!parseInt(argv[++i], options.ranks_per_node))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return config.n_processes > 0 && options.processes_per_rank > 0 && options.ranks_per_node >= 0 && options.replay_passes > 0 && config.d_houses > 0 && config.p_pasers > 0 &&
+           config.work_min_ms >= 0 && config.work_max_ms >= config.work_min_ms && config.think_mean_ms > 0.0 && config.time_scale > 0.0 &&
+           config.target_cycles >= 0 && config.run_seconds > 0 && config.heartbeat_ms >= 0 &&
+           config.work_pareto_alpha >= 0.0 && config.burst_factor >= 1.0 && config.burst_period_ms > 0.0 &&
+           traceReadable(config);
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Sums the per-rank counters on rank 0 and concatenates every rank's entry latencies there.
+static RunStats gatherRunStats(const RunStats &stats, int world_rank, int world_size)
+{
+    RunStats total;
+    long long local_counts[4] = {stats.cs_entries, stats.no_free_house_retries, stats.messages_sent, stats.batches_sent};
+    long long total_counts[4] = {0, 0, 0, 0};
+    MPI_Reduce(local_counts, total_counts, 4, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&stats.elapsed_seconds, &total.elapsed_seconds, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    total.cs_entries = total_counts[0];
+    total.no_free_house_retries = total_counts[1];
+    total.messages_sent = total_counts[2];
+    total.batches_sent = total_counts[3];
+
+    int local_samples = static_cast<int>(stats.entry_latencies_us.size());
+    std::vector<int> sample_counts(world_rank == 0 ? world_size : 0);
+    MPI_Gather(&local_samples, 1, MPI_INT, sample_counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::vector<int> displacements(sample_counts.size(), 0);
+    if (world_rank == 0)
+    {
+        int total_samples = 0;
+        for (size_t r = 0; r < sample_counts.size(); ++r)
+        {
+            displacements[r] = total_samples;
+            total_samples += sample_counts[r];
+        }
+        total.entry_latencies_us.resize(total_samples);
+    }
+    MPI_Gatherv(stats.entry_latencies_us.data(), local_samples, MPI_DOUBLE, total.entry_latencies_us.data(),
+                sample_counts.data(), displacements.data(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    return total;
+}
+
+static void mergeRunStats(RunStats &total, const RunStats &stats)
+{
+    total.cs_entries += stats.cs_entries;
+    total.no_free_house_retries += stats.no_free_house_retries;
+    total.messages_sent += stats.messages_sent;
+    total.batches_sent += stats.batches_sent;
+    total.elapsed_seconds = std::max(total.elapsed_seconds, stats.elapsed_seconds);
+    total.entry_latencies_us.insert(total.entry_latencies_us.end(), stats.entry_latencies_us.begin(),
+                                    stats.entry_latencies_us.end());
+}
+
+static void printBenchmarkReport(RunStats &total, const SimConfig &config, unsigned long long log_lines_dropped)
+{
+    std::vector<double> &latencies = total.entry_latencies_us;
+    std::sort(latencies.begin(), latencies.end());
+    long long entries = total.cs_entries;
+    double elapsed = total.elapsed_seconds;
+    std::printf("benchmark: processes=%d houses=%d pasers=%d work_ms=%d:%d think_ms=%.1f time_scale=%g cycles=%d\n",
+                config.n_processes, config.d_houses, config.p_pasers, config.work_min_ms, config.work_max_ms,
+                config.think_mean_ms, config.time_scale, config.target_cycles);
+    std::printf("  elapsed:            %.3f s\n", elapsed);
+    std::printf("  cs entries:         %lld (%.2f/s)\n", entries, elapsed > 0.0 ? entries / elapsed : 0.0);
+    std::printf("  no-free-house:      %lld\n", total.no_free_house_retries);
+    std::printf("  entry latency (ms): p50=%.3f p90=%.3f p99=%.3f max=%.3f\n", percentile(latencies, 0.50) / 1000.0,
+                percentile(latencies, 0.90) / 1000.0, percentile(latencies, 0.99) / 1000.0,
+                latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+    std::printf("  messages:           %lld in %lld batches (%.2f per entry)\n", total.messages_sent, total.batches_sent,
+                entries > 0 ? static_cast<double>(total.messages_sent) / entries : 0.0);
+    if (log_lines_dropped > 0)
+    {
+        std::printf("  log lines dropped:  %llu\n", log_lines_dropped);
+    }
+    std::fflush(stdout);
+}
+
+static void writeMetrics(const std::string &path, const std::vector<MetricsSnapshot> &per_rank)
+{
+    if (!writeMetricsJson(path, per_rank))
+    {
+        std::cerr << "Error: could not write metrics to " << path << std::endl;
+    }
+}
+
+// Ships every rank's snapshots to rank 0 as raw bytes; all ranks run the same binary on the same architecture
+// and host the same number of processes, so the result is ordered by logical rank.
+static std::vector<MetricsSnapshot> gatherMetrics(const std::vector<MetricsSnapshot> &local, int world_rank,
+                                                  int world_size)
+{
+    int bytes = static_cast<int>(local.size() * sizeof(MetricsSnapshot));
+    std::vector<MetricsSnapshot> per_rank(world_rank == 0 ? world_size * local.size() : 0);
+    MPI_Gather(local.data(), bytes, MPI_BYTE, per_rank.data(), bytes, MPI_BYTE, 0, MPI_COMM_WORLD);
+    return per_rank;
+}
+
+// Collects every rank's serialized events on rank 0, which writes the single trace file.
+static void gatherTrace(const std::string &path, int world_rank, int world_size)
+{
+    std::string local = Tracer::instance().serializeEvents();
+    int local_size = static_cast<int>(local.size());
+    std::vector<int> sizes(world_rank == 0 ? world_size : 0);
+    MPI_Gather(&local_size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::vector<int> displacements(sizes.size(), 0);
+    std::vector<char> all;
+    if (world_rank == 0)
+    {
+        int total = 0;
+        for (size_t r = 0; r < sizes.size(); ++r)
+        {
+            displacements[r] = total;
+            total += sizes[r];
+        }
+        all.resize(total);
+    }
+    MPI_Gatherv(local.data(), local_size, MPI_CHAR, all.data(), sizes.data(), displacements.data(), MPI_CHAR, 0,
+                MPI_COMM_WORLD);
+    if (world_rank != 0)
+    {
+        return;
+    }
+    std::vector<std::string> chunks;
+    for (size_t r = 0; r < sizes.size(); ++r)
+    {
+        chunks.emplace_back(all.data() + displacements[r], sizes[r]);
+    }
+    if (!Tracer::writeFile(path, chunks))
+    {
+        std::cerr << "Error: could not write trace to " << path << std::endl;
+    }
+}
+
+static void writeLocalTrace(const std::string &path)
+{
+    if (!Tracer::writeFile(path, {Tracer::instance().serializeEvents()}))
+    {
+        std::cerr << "Error: could not write trace to " << path << std::endl;
+    }
+}
+
+static void startLogger(const std::string &path, const RunOptions &options)
+{
+    // Benchmark runs default to WARN so logging does not dominate the measured time.
+    const char *log_level_env = std::getenv("PROZ_LOG_LEVEL");
+    std::string log_level_name = !options.log_level.empty() ? options.log_level : (log_level_env ? log_level_env : "");
+    LogLevel log_level = Logger::parseLevel(log_level_name, options.benchmark_mode ? LogLevel::WARN : LogLevel::INFO);
+    LogOverflow overflow = options.backend == RunOptions::Backend::SIMULATED ? LogOverflow::BLOCK : LogOverflow::DROP;
+    Logger::parseOverflow(options.log_overflow, overflow);
+    Logger::instance().start(path, log_level, overflow);
+}
+
+static void stopLogger()
+{
+    Logger::instance().stop();
+    unsigned long long dropped = Logger::instance().droppedLines();
+    if (dropped > 0)
+    {
+        std::cerr << "Warning: the log is missing " << dropped
+                  << " lines; --log-overflow block or spill keeps them." << std::endl;
+    }
+}
+
+static void startTracer(const RunOptions &options)
+{
+    if (!options.trace_path.empty())
+    {
+        Tracer::instance().start(options.trace_events_per_thread);
+    }
+}
+
+static void stopTracer(const RunOptions &options)
+{
+    if (!options.trace_path.empty())
+    {
+        Tracer::instance().stop();
+    }
+}
+
+// A replay re-runs the same think and work times, so a recorded run needs a seed it can write down.
+static void pinSeedForRecording(SimConfig &config, const RunOptions &options)
+{
+    if (!options.record_prefix.empty() && config.seed == 0)
+    {
+        config.seed = static_cast<unsigned long long>(std::chrono::system_clock::now().time_since_epoch().count());
+    }
+}
+
+static void startRecording(ProcessLogic &process, int process_id, const SimConfig &config, const RunOptions &options)
+{
+    if (options.record_prefix.empty())
+    {
+        return;
+    }
+    std::string path = options.record_prefix + ".p" + std::to_string(process_id) + ".bin";
+    if (!process.startRecording(path, config))
+    {
+        std::cerr << "Error: could not write replay log " << path << std::endl;
+    }
+}
+
+static void runProcessThreads(std::vector<std::unique_ptr<ProcessLogic>> &processes)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(processes.size());
+    for (auto &process : processes)
+    {
+        threads.emplace_back([&process]()
+                             { process->run(); });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+// Every process is a ProcessLogic on its own thread, exchanging batches through in-memory mailboxes.
+static int runInProcess(SimConfig config, const RunOptions &options)
+{
+    pinSeedForRecording(config, options);
+    startLogger("proz_sim.inproc.log", options);
+    startTracer(options);
+
+    InProcessNetwork network(config.n_processes);
+    SharedHouseWindow house_window(config.d_houses);
+    std::vector<std::unique_ptr<InProcessTransport>> transports;
+    std::vector<std::unique_ptr<ProcessLogic>> processes;
+    transports.reserve(config.n_processes);
+    processes.reserve(config.n_processes);
+    for (int rank = 0; rank < config.n_processes; ++rank)
+    {
+        transports.push_back(std::make_unique<InProcessTransport>(network, rank));
+        processes.push_back(std::make_unique<ProcessLogic>(rank + 1, config, *transports.back(), &house_window));
+        startRecording(*processes.back(), rank + 1, config, options);
+    }
+
+    runProcessThreads(processes);
+    stopTracer(options);
+    if (!options.trace_path.empty())
+    {
+        writeLocalTrace(options.trace_path);
+    }
+
+    if (options.benchmark_mode)
+    {
+        RunStats total;
+        for (const auto &process : processes)
+        {
+            mergeRunStats(total, process->getStats());
+        }
+        printBenchmarkReport(total, config, Logger::instance().droppedLines());
+    }
+    else
+    {
+        std::cout << "All " << config.n_processes << " in-process ProcessLogic::run() calls completed." << std::endl;
+    }
+    if (!options.metrics_path.empty())
+    {
+        std::vector<MetricsSnapshot> per_rank;
+        for (const auto &process : processes)
+        {
+            per_rank.push_back(process->getMetrics());
+        }
+        writeMetrics(options.metrics_path, per_rank);
+    }
+
+    processes.clear();
+    transports.clear();
+    stopLogger();
+    return 0;
+}
+
+// Every process is stepped by the discrete-event simulator on this thread; all times are virtual.
+static int runSimulated(SimConfig config, const RunOptions &options)
+{
+    if (config.seed == 0)
+    {
+        config.seed = 1;
+    }
+    startLogger("proz_sim.sim.log", options);
+    startTracer(options);
+
+    auto wall_start = std::chrono::steady_clock::now();
+    DiscreteEventSimulator simulator(config, options.latency, options.stall);
+    for (int rank = 0; rank < simulator.size(); ++rank)
+    {
+        startRecording(simulator.process(rank), rank + 1, config, options);
+    }
+    simulator.run();
+    stopTracer(options);
+    if (!options.trace_path.empty())
+    {
+        writeLocalTrace(options.trace_path);
+    }
+    double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    if (options.benchmark_mode)
+    {
+        RunStats total;
+        for (int rank = 0; rank < simulator.size(); ++rank)
+        {
+            mergeRunStats(total, simulator.process(rank).getStats());
+        }
+        printBenchmarkReport(total, config, Logger::instance().droppedLines());
+    }
+    std::printf("simulated %.3f s in %.3f s wall time, %lld events, seed %llu\n", simulator.simulatedSeconds(), wall_seconds,
+                simulator.eventsProcessed(), config.seed);
+    unsigned long long suspicions = 0;
+    for (int rank = 0; rank < simulator.size(); ++rank)
+    {
+        suspicions += simulator.process(rank).getMetrics().peers_suspected;
+    }
+    std::printf("exclusion violations: %lld house, %lld paser; %llu peer suspicions\n", simulator.houseViolations(),
+                simulator.paserViolations(), suspicions);
+    std::fflush(stdout);
+    if (!options.metrics_path.empty())
+    {
+        std::vector<MetricsSnapshot> per_rank;
+        for (int rank = 0; rank < simulator.size(); ++rank)
+        {
+            per_rank.push_back(simulator.process(rank).getMetrics());
+        }
+        writeMetrics(options.metrics_path, per_rank);
+    }
+
+    stopLogger();
+    if (simulator.houseViolations() > 0 || simulator.paserViolations() > 0)
+    {
+        std::cerr << "Error: mutual exclusion was violated." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Re-runs one recorded process offline: a warm-up pass, then options.replay_passes timed passes.
+static int runReplay(const RunOptions &options)
+{
+    ReplayLogContents log;
+    if (!readReplayLog(options.replay_path, log))
+    {
+        std::cerr << "Error: " << options.replay_path << " is not a readable replay log." << std::endl;
+        return 1;
+    }
+    // Replays are measurements, so logging defaults to WARN like a benchmark run.
+    RunOptions replay_options = options;
+    replay_options.benchmark_mode = true;
+    startLogger("proz_sim.replay.log", replay_options);
+    if (log.config.clock_mode == ClockMode::HYBRID)
+    {
+        std::cerr << "Warning: hybrid clock values depend on wall time, so this replay only approximates the run." << std::endl;
+    }
+    if (log.config.house_algorithm == MutexAlgorithm::HOUSE_WINDOW)
+    {
+        std::cerr << "Warning: the house window is not recorded; the replay claims houses from an empty window." << std::endl;
+    }
+
+    ReplayDriver driver(std::move(log));
+    if (!driver.isValid())
+    {
+        std::cerr << "Error: " << options.replay_path << " has a truncated or corrupt record." << std::endl;
+        stopLogger();
+        return 1;
+    }
+    RunStats first_pass = driver.replayOnce();
+    long long expected_entries = first_pass.cs_entries;
+    long long diverged_passes = 0;
+    auto wall_start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < options.replay_passes; ++pass)
+    {
+        diverged_passes += driver.replayOnce().cs_entries != expected_entries;
+    }
+    double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    long long messages = driver.messagesPerPass() * options.replay_passes;
+    std::printf("replay: P%d of %d processes, per pass %lld messages in, %lld steps, %lld messages out, %lld cs entries\n",
+                driver.processId(), driver.config().n_processes, driver.messagesPerPass(), driver.stepsPerPass(),
+                first_pass.messages_sent, expected_entries);
+    std::printf("  passes:             %d in %.3f s (%.1f/s)\n", options.replay_passes, wall_seconds,
+                options.replay_passes / wall_seconds);
+    std::printf("  per message:        %.1f ns\n", messages > 0 ? wall_seconds * 1e9 / messages : 0.0);
+    if (diverged_passes > 0)
+    {
+        std::printf("  diverged passes:    %lld\n", diverged_passes);
+    }
+    std::fflush(stdout);
+    stopLogger();
+    return diverged_passes > 0 ? 1 : 0;
+}
 
 int main(int argc, char *argv[])
 {
-    MPI_Init(&argc, &argv);
+    SimConfig config;
+    RunOptions options;
+    bool arguments_valid = parseArguments(argc, argv, config, options);
+    if (!options.replay_path.empty())
+    {
+        if (!arguments_valid)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runReplay(options);
+    }
+    if (options.backend == RunOptions::Backend::IN_PROCESS || options.backend == RunOptions::Backend::SIMULATED)
+    {
+        if (!arguments_valid)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return options.backend == RunOptions::Backend::IN_PROCESS ? runInProcess(config, options)
+                                                                  : runSimulated(config, options);
+    }
+
+    // Listener, sender and main loop all call into MPI concurrently.
+    int provided_thread_level = MPI_THREAD_SINGLE;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided_thread_level);
     int world_rank, world_size;
     MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &world_size);
 
+    if (provided_thread_level < MPI_THREAD_MULTIPLE)
+    {
+        if (world_rank == 0)
+        {
+            std::cerr << "Error: MPI library does not provide MPI_THREAD_MULTIPLE." << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
     if (world_size < 1)
     {
         if (world_rank == 0)
@@ -26,13 +890,135 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    ProcessLogic process_logic(world_rank + 1, world_rank,
-                               world_size, D_HOUSES_DEFAULT, P_PASERS_DEFAULT);
+    if (!arguments_valid)
+    {
+        if (world_rank == 0)
+        {
+            printUsage(argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    // Hybrid ranks host K logical processes each; logical id l lives on rank (l - 1) / K.
+    bool hybrid = options.backend == RunOptions::Backend::HYBRID;
+    int processes_per_rank = hybrid ? options.processes_per_rank : 1;
+    config.n_processes = world_size * processes_per_rank;
+    pinSeedForRecording(config, options);
+
+    startLogger("proz_sim.rank" + std::to_string(world_rank) + ".log", options);
+    startTracer(options);
+
+    {
+        std::unique_ptr<HybridNode> node;
+        MpiTransport *mpi_transport = nullptr;
+        std::unique_ptr<MpiHouseWindow> house_window;
+        std::vector<std::unique_ptr<Transport>> transports;
+        std::vector<std::unique_ptr<ProcessLogic>> processes;
+        if (hybrid)
+        {
+            node = std::make_unique<HybridNode>(processes_per_rank);
+            for (int local = 0; local < processes_per_rank; ++local)
+            {
+                transports.push_back(std::make_unique<HybridTransport>(*node, local));
+            }
+        }
+        else
+        {
+            auto transport = std::make_unique<MpiTransport>(options.ranks_per_node);
+            mpi_transport = transport.get();
+            transports.push_back(std::move(transport));
+        }
+        if (config.house_algorithm == MutexAlgorithm::HOUSE_WINDOW)
+        {
+            house_window = std::make_unique<MpiHouseWindow>(config.d_houses);
+        }
+        for (auto &transport : transports)
+        {
+            processes.push_back(std::make_unique<ProcessLogic>(transport->rank() + 1, config, *transport, house_window.get()));
+            startRecording(*processes.back(), transport->rank() + 1, config, options);
+        }
 
-    process_logic.run();
+        if (node)
+        {
+            node->startDispatcher();
+            runProcessThreads(processes);
+            node->stop();
+        }
+        else
+        {
+            processes.front()->run();
+        }
+        stopTracer(options);
+        if (!options.trace_path.empty())
+        {
+            gatherTrace(options.trace_path, world_rank, world_size);
+        }
 
-    std::cout << "[P" << (world_rank + 1) << "] ProcessLogic::run() completed. Finalizing MPI." << std::endl;
+        if (options.benchmark_mode)
+        {
+            RunStats local_total;
+            for (const auto &process : processes)
+            {
+                mergeRunStats(local_total, process->getStats());
+            }
+            RunStats total = gatherRunStats(local_total, world_rank, world_size);
+            unsigned long long local_dropped = Logger::instance().droppedLines();
+            unsigned long long total_dropped = 0;
+            MPI_Reduce(&local_dropped, &total_dropped, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+            if (world_rank == 0)
+            {
+                printBenchmarkReport(total, config, total_dropped);
+            }
+            if (node)
+            {
+                long long local_remote[2] = {node->remoteMessagesSent(), node->remoteBatchesSent()};
+                long long total_remote[2] = {0, 0};
+                MPI_Reduce(local_remote, total_remote, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+                if (world_rank == 0)
+                {
+                    std::printf("  inter-rank:         %lld MPI messages for %lld remote batches\n", total_remote[0],
+                                total_remote[1]);
+                }
+            }
+            else
+            {
+                long long local_remote[2] = {mpi_transport->interNodeMessagesSent(), mpi_transport->interNodeBatchesSent()};
+                long long total_remote[2] = {0, 0};
+                MPI_Reduce(local_remote, total_remote, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+                if (world_rank == 0)
+                {
+                    std::printf("  inter-node:         %lld MPI messages for %lld remote batches\n", total_remote[0],
+                                total_remote[1]);
+                }
+            }
+        }
+        else
+        {
+            for (const auto &transport : transports)
+            {
+                std::cout << "[P" << (transport->rank() + 1) << "] ProcessLogic::run() completed. Finalizing MPI."
+                          << std::endl;
+            }
+        }
+        if (!options.metrics_path.empty())
+        {
+            std::vector<MetricsSnapshot> local;
+            for (const auto &process : processes)
+            {
+                local.push_back(process->getMetrics());
+            }
+            std::vector<MetricsSnapshot> per_rank = gatherMetrics(local, world_rank, world_size);
+            if (world_rank == 0)
+            {
+                writeMetrics(options.metrics_path, per_rank);
+            }
+        }
+        processes.clear();
+        transports.clear();
+        house_window.reset();
+    }
 
+    stopLogger();
     MPI_Finalize();
     return 0;
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 const int N_PROCESSES_DEFAULT = 5;
 const int D_HOUSES_DEFAULT = 3;
 const int P_PASERS_DEFAULT = 2;
@@ -25,17 +29,118 @@ enum class MessageType
     REPLY_HOUSE,
     REQUEST_PASER,
     REPLY_PASER,
-    UPDATE_HOUSE_STATE
+    UPDATE_HOUSE_STATE,
+    MAEKAWA_REQUEST,
+    MAEKAWA_LOCKED,
+    MAEKAWA_FAILED,
+    MAEKAWA_INQUIRE,
+    MAEKAWA_RELINQUISH,
+    MAEKAWA_RELEASE,
+    TOKEN_REQUEST,
+    TOKEN,
+    RELEASE_PASER,
+    HOUSE_BUSY,
+    HEARTBEAT
+};
+
+const int MESSAGE_TYPE_COUNT = static_cast<int>(MessageType::HEARTBEAT) + 1;
+
+inline const char *messageTypeName(MessageType type)
+{
+    static const char *const names[MESSAGE_TYPE_COUNT] = {
+        "REQUEST_HOUSE", "REPLY_HOUSE", "REQUEST_PASER", "REPLY_PASER", "UPDATE_HOUSE_STATE",
+        "MAEKAWA_REQUEST", "MAEKAWA_LOCKED", "MAEKAWA_FAILED", "MAEKAWA_INQUIRE", "MAEKAWA_RELINQUISH",
+        "MAEKAWA_RELEASE", "TOKEN_REQUEST", "TOKEN", "RELEASE_PASER", "HOUSE_BUSY", "HEARTBEAT"};
+    return names[static_cast<int>(type)];
+}
+
+inline const char *processStateName(ProcessState state)
+{
+    static const char *const names[] = {"IDLE", "WANT_HOUSE", "HAVE_HOUSE_WANT_PASER", "HAVE_BOTH", "RELEASING"};
+    return names[static_cast<int>(state)];
+}
+
+enum class MutexAlgorithm
+{
+    RICART_AGRAWALA, // broadcast to all N-1 peers, 2(N-1) messages per entry
+    MAEKAWA,         // grid quorum of ~2*sqrt(N) peers
+    SUZUKI_KASAMI,   // circulating token, 0 messages to re-enter, N per contended entry
+    HOUSE_WINDOW     // no lock messages: houses are claimed by compare-and-swap on a shared window (HouseWindow.h)
+};
+
+enum class HouseLockScope
+{
+    PER_HOUSE, // Ricart-Agrawala per house: requests name one free house and queue only behind requests for that
+               // house, so different houses are taken in parallel
+    POOL       // one lock for the whole pool, held while choosing a house and until it is released
+};
+
+enum class ClockMode
+{
+    LAMPORT, // plain logical counter
+    HYBRID   // hybrid logical clock: physical milliseconds in the high bits, a logical counter in the low ones
+};
+
+enum class WorkloadKind
+{
+    CLOSED_LOOP, // the next cycle starts an exponential think time after the previous one ends
+    POISSON,     // open loop: arrivals at exponential intervals whether or not the process is busy
+    BURSTY,      // open loop: Poisson arrivals whose rate switches between a calm and a burst phase
+    TRACE        // open loop: arrival and work times read from SimConfig::trace_path (Workload.h)
 };
 
 const int HOUSE_STATE_FREE = 0;
 
+// Clock values are 64-bit and travel as two wire words, high word first.
+using Timestamp = std::int64_t;
+const int TIMESTAMP_WORDS = 2;
+
+inline void appendTimestamp(std::vector<int> &words, Timestamp ts)
+{
+    words.push_back(static_cast<int>(static_cast<std::uint64_t>(ts) >> 32));
+    words.push_back(static_cast<int>(static_cast<std::uint32_t>(ts)));
+}
+
+inline Timestamp readTimestamp(const int *words)
+{
+    return static_cast<Timestamp>((static_cast<std::uint64_t>(static_cast<std::uint32_t>(words[0])) << 32) |
+                                  static_cast<std::uint32_t>(words[1]));
+}
+
+struct SimConfig
+{
+    int n_processes = N_PROCESSES_DEFAULT;
+    int d_houses = D_HOUSES_DEFAULT;
+    int p_pasers = P_PASERS_DEFAULT;
+    bool prefer_last_house = false; // try the previously held house first for locality across cycles
+    MutexAlgorithm house_algorithm = MutexAlgorithm::RICART_AGRAWALA;
+    HouseLockScope house_locks = HouseLockScope::PER_HOUSE; // Maekawa and the token always lock the pool
+    bool piggyback_house_state = false; // carry house versions on house replies and paser broadcasts instead of UPDATE_HOUSE_STATE
+    ClockMode clock_mode = ClockMode::LAMPORT;
+    int heartbeat_ms = 0; // failure detector: heartbeat period to otherwise silent peers, 0 = off
+
+    // Workload; all durations are multiplied by time_scale.
+    WorkloadKind workload = WorkloadKind::CLOSED_LOOP;
+    int work_min_ms = 4000;
+    int work_max_ms = 5000;
+    double work_pareto_alpha = 0.0; // > 0: work times are Pareto with scale work_min_ms instead of uniform
+    double think_mean_ms = 200.0; // exponential; same rate as the original 25% chance every 50 ms
+    double burst_factor = 10.0;      // BURSTY: arrival rate in a burst over the calm rate; the mean stays think_mean_ms
+    double burst_period_ms = 5000.0; // BURSTY: mean length of each calm and each burst phase, exponential
+    std::string trace_path;          // TRACE
+    double time_scale = 1.0;
+    int target_cycles = 0;        // critical-section entries per process, 0 = run until run_seconds
+    int run_seconds = 600;
+    unsigned long long seed = 0; // 0 = seed from the wall clock
+};
+
 struct Message
 {
     MessageType type;
     int sender_id;
-    int timestamp;
+    Timestamp timestamp;
     int house_id;
     int new_house_status;
+    std::vector<int> payload; // variable-length part, e.g. the Suzuki-Kasami token
     // TODO Może warto użyć unii do wiadomości, chyba, że są jakieś lepsze metody typu msg type.
 };